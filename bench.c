@@ -0,0 +1,440 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    WORKLOAD GENERATOR AND BENCHMARK HARNESS (./bench.sh [options], see print_usage)
+    Starts a manager per scheduling policy, submits the same generated workload of ./bin/prog jobs to each through
+    its control socket, waits for every job to exit and reports throughput, waiting and turnaround times and signals
+    from the manager's own statistics.
+*/
+
+enum {
+    NS_PER_US = 1000,
+    NS_PER_MS = 1000000,
+    NS_PER_SEC = 1000000000
+};
+
+// Header of every response message of the control socket (See the Control socket section of the README)
+typedef struct response_header {
+    uint16_t status;
+    uint16_t flags;
+    uint32_t length;
+    int64_t value;
+} response_header;
+
+enum {
+    RESPONSE_MORE = 1,
+    RESPONSE_SIZE_MAX = 65536
+};
+
+// How the runtimes of the jobs are drawn around the mean runtime
+typedef enum runtime_distribution {
+    RUNTIME_FIXED = 0,
+    // Uniform between 0 and twice the mean
+    RUNTIME_UNIFORM = 1,
+    RUNTIME_EXPONENTIAL = 2
+} runtime_distribution;
+
+// Workload and manager settings (Set from the command line)
+typedef struct bench_config {
+    int jobs;
+    // Mean number of arrivals per second (Poisson arrivals), 0 submits every job at once
+    double arrival_rate;
+    runtime_distribution distribution;
+    int64_t mean_runtime;
+    // Fraction of its runtime a job spins on the CPU, it sleeps for the rest
+    double cpu_fraction;
+    int cpus;
+    // Comma-separated policies, each benchmarked with a fresh manager
+    const char * policies;
+    const char * quantum;
+    uint64_t seed;
+    const char * manager;
+    const char * prog;
+    // Give up on a policy after this long (ns)
+    int64_t timeout;
+} bench_config;
+
+bench_config config = {
+    .jobs = 200,
+    .arrival_rate = 100,
+    .distribution = RUNTIME_EXPONENTIAL,
+    .mean_runtime = 20 * NS_PER_MS,
+    .cpu_fraction = 1.0,
+    .cpus = 1,
+    .policies = "sjf,srtf,rr,mlfq",
+    .quantum = NULL,
+    .seed = 1,
+    .manager = "./bin/manager",
+    .prog = "./bin/prog",
+    .timeout = 120LL * NS_PER_SEC
+};
+
+// A job of the workload: when it is submitted (ns after the first one) and how long it runs
+typedef struct bench_job {
+    int64_t arrival;
+    int64_t runtime;
+} bench_job;
+
+// A manager being benchmarked: its pid, the pipe its user interface reads and the control socket connection
+typedef struct manager_instance {
+    pid_t pid;
+    int input_fd;
+    int socket_fd;
+    char socket_path[108];
+} manager_instance;
+
+/*
+    UTILITY FUNCTIONS
+*/
+
+int64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void sleep_until(int64_t deadline) {
+    struct timespec time = {.tv_sec = deadline / NS_PER_SEC, .tv_nsec = deadline % NS_PER_SEC};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) == EINTR) {
+    }
+}
+
+// xorshift64* generator, the same seed gives every policy the same workload
+uint64_t random_state;
+
+double random_uniform(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    // 53 random bits in [0, 1)
+    return (double) ((random_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+double random_exponential(double mean) {
+    return -mean * log(1.0 - random_uniform());
+}
+
+// Runtime with the same syntax as the runtime budgets of the manager: seconds, or a number with a unit
+bool parse_runtime(const char * text, int64_t * runtime) {
+    char * end;
+    double value = strtod(text, &end);
+    double scale = NS_PER_SEC;
+    if (strcmp(end, "ns") == 0) {
+        scale = 1;
+    } else if (strcmp(end, "us") == 0) {
+        scale = NS_PER_US;
+    } else if (strcmp(end, "ms") == 0) {
+        scale = NS_PER_MS;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60.0 * NS_PER_SEC;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return false;
+    }
+    if (end == text || value <= 0) {
+        return false;
+    }
+    *runtime = (int64_t) (value * scale);
+    return true;
+}
+
+// Value of "key" in the first JSON object named "object" (The stats json of the manager has no nested arrays)
+double json_number(const char * json, const char * object, const char * key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":{", object);
+    const char * start = strstr(json, pattern);
+    if (start == NULL) {
+        return NAN;
+    }
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char * value = strstr(start, pattern);
+    return value == NULL ? NAN : strtod(value + strlen(pattern), NULL);
+}
+
+/*
+    WORKLOAD
+*/
+
+void generate_workload(bench_job * jobs) {
+    random_state = config.seed * 0x9E3779B97F4A7C15ULL + 1;
+    int64_t arrival = 0;
+    for (int i = 0; i < config.jobs; ++i) {
+        if (config.arrival_rate > 0 && i > 0) {
+            arrival += (int64_t) random_exponential(NS_PER_SEC / config.arrival_rate);
+        }
+        double runtime = config.mean_runtime;
+        if (config.distribution == RUNTIME_UNIFORM) {
+            runtime = 2.0 * config.mean_runtime * random_uniform();
+        } else if (config.distribution == RUNTIME_EXPONENTIAL) {
+            runtime = random_exponential(config.mean_runtime);
+        }
+        jobs[i].arrival = arrival;
+        // At least a millisecond, shorter jobs only measure the launch
+        jobs[i].runtime = runtime < NS_PER_MS ? NS_PER_MS : (int64_t) runtime;
+    }
+}
+
+/*
+    MANAGER CONTROL
+*/
+
+// Send one request and collect the whole response (Every message up to the last one), returns its status or -1
+int request(manager_instance * m, const char * command, char * output, size_t size, int64_t * value) {
+    if (send(m->socket_fd, command, strlen(command), 0) == -1) {
+        perror("Send failed in request()\n");
+        return -1;
+    }
+    static char message[RESPONSE_SIZE_MAX];
+    size_t length = 0;
+    response_header header;
+    do {
+        ssize_t received = recv(m->socket_fd, message, sizeof(message), 0);
+        if (received < (ssize_t) sizeof(header)) {
+            perror("Recv failed in request()\n");
+            return -1;
+        }
+        memcpy(&header, message, sizeof(header));
+        size_t copy = header.length < size - 1 - length ? header.length : size - 1 - length;
+        memcpy(output + length, message + sizeof(header), copy);
+        length += copy;
+    } while (header.flags & RESPONSE_MORE);
+    output[length] = '\0';
+    if (value != NULL) {
+        *value = header.value;
+    }
+    return header.status;
+}
+
+// Start a manager with a policy and connect to its control socket
+bool start_manager(manager_instance * m, const char * policy) {
+    snprintf(m->socket_path, sizeof(m->socket_path), "/tmp/manager-bench-%d.sock", (int) getpid());
+    unlink(m->socket_path);
+    char cpus[16];
+    snprintf(cpus, sizeof(cpus), "%d", config.cpus);
+    const char * argv[12] = {config.manager, "-p", policy, "-c", cpus, "-l", m->socket_path};
+    int argc = 7;
+    if (config.quantum != NULL) {
+        argv[argc++] = "-Q";
+        argv[argc++] = config.quantum;
+    }
+    argv[argc] = NULL;
+    int input[2];
+    if (pipe2(input, O_CLOEXEC) == -1) {
+        perror("Pipe2 failed in start_manager()\n");
+        return false;
+    }
+    m->pid = fork();
+    if (m->pid == -1) {
+        perror("Fork failed in start_manager()\n");
+        return false;
+    }
+    if (m->pid == 0) {
+        // The user interface of the manager reads the pipe, an end of file there makes the manager exit
+        dup2(input[0], STDIN_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execv(config.manager, (char * const *) argv);
+        perror("Execution failed in start_manager()\n");
+        _exit(EXIT_FAILURE);
+    }
+    close(input[0]);
+    m->input_fd = input[1];
+    m->socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    memcpy(address.sun_path, m->socket_path, sizeof(address.sun_path));
+    // The socket appears once the manager has set up its event loop
+    int64_t deadline = monotonic_ns() + 5LL * NS_PER_SEC;
+    while (connect(m->socket_fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        if (monotonic_ns() > deadline || waitpid(m->pid, NULL, WNOHANG) != 0) {
+            fprintf(stderr, "Could not connect to the manager at %s\n", m->socket_path);
+            return false;
+        }
+        usleep(10000);
+    }
+    return true;
+}
+
+// Close the user interface pipe (The manager kills what is left and exits) and wait for the manager
+void stop_manager(manager_instance * m) {
+    close(m->socket_fd);
+    close(m->input_fd);
+    waitpid(m->pid, NULL, 0);
+    unlink(m->socket_path);
+}
+
+/*
+    BENCHMARK
+*/
+
+// Run the workload under one policy and print its row of the report
+bool bench_policy(const char * policy, const bench_job * jobs) {
+    manager_instance m;
+    if (!start_manager(&m, policy)) {
+        return false;
+    }
+    static char output[RESPONSE_SIZE_MAX];
+    char command[256];
+    int64_t submit_total = 0;
+    int64_t submit_max = 0;
+    int submitted = 0;
+    int64_t start = monotonic_ns();
+    for (int i = 0; i < config.jobs; ++i) {
+        sleep_until(start + jobs[i].arrival);
+        // The job runs for its runtime, which is also its budget (An exact estimate)
+        snprintf(command, sizeof(command), "run %s %.2f %lldns", config.prog, config.cpu_fraction,
+                 (long long) jobs[i].runtime);
+        int64_t sent = monotonic_ns();
+        if (request(&m, command, output, sizeof(output), NULL) != 0) {
+            fprintf(stderr, "%s: %s", policy, output);
+            continue;
+        }
+        int64_t latency = monotonic_ns() - sent;
+        submit_total += latency;
+        submit_max = latency > submit_max ? latency : submit_max;
+        submitted++;
+    }
+    // Every job has exited once the turnaround histogram of the manager counts all of them
+    int64_t end;
+    while (true) {
+        if (request(&m, "stats json", output, sizeof(output), NULL) != 0) {
+            stop_manager(&m);
+            return false;
+        }
+        end = monotonic_ns();
+        if (json_number(output, "turnaround", "count") >= submitted) {
+            break;
+        }
+        if (end - start > config.timeout) {
+            fprintf(stderr, "%s: timed out waiting for the jobs to exit\n", policy);
+            break;
+        }
+        usleep(5000);
+    }
+    stop_manager(&m);
+    double seconds = (double) (end - start) / NS_PER_SEC;
+    printf("%-6s %6d %9.1f %9.2f %9.2f %11.2f %11.2f %8.0f %8.0f %8.0f %9.1f %9.1f\n", policy, submitted,
+           submitted / seconds, json_number(output, "wait", "mean_ns") / NS_PER_MS,
+           json_number(output, "wait", "p99_ns") / NS_PER_MS, json_number(output, "turnaround", "mean_ns") / NS_PER_MS,
+           json_number(output, "turnaround", "p99_ns") / NS_PER_MS, json_number(output, "counters", "stops_sent"),
+           json_number(output, "counters", "continues_sent"), json_number(output, "counters", "signals_avoided"),
+           submitted > 0 ? (double) submit_total / submitted / NS_PER_US : 0.0, (double) submit_max / NS_PER_US);
+    return true;
+}
+
+void print_usage(const char * program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  -n N        Number of jobs (default %d)\n", config.jobs);
+    fprintf(stderr, "  -r RATE     Mean arrivals per second, Poisson (0 submits every job at once, default %.0f)\n", config.arrival_rate);
+    fprintf(stderr, "  -d DIST     Runtime distribution: fixed, uniform or exp (default)\n");
+    fprintf(stderr, "  -t TIME     Mean runtime of a job (default 20ms)\n");
+    fprintf(stderr, "  -x FRACTION Fraction of its runtime a job spins on the CPU, it sleeps for the rest (default 1)\n");
+    fprintf(stderr, "  -c N        CPUs of the manager (default 1)\n");
+    fprintf(stderr, "  -p LIST     Comma-separated policies to compare (default %s)\n", config.policies);
+    fprintf(stderr, "  -Q TIME     Quantum passed to the manager\n");
+    fprintf(stderr, "  -s SEED     Seed of the workload (default 1)\n");
+    fprintf(stderr, "  -m PATH     Manager binary (default %s)\n", config.manager);
+    fprintf(stderr, "  -j PATH     Job binary (default %s)\n", config.prog);
+}
+
+void parse_options(int argc, char * argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "n:r:d:t:x:c:p:Q:s:m:j:h")) != -1) {
+        switch (option) {
+            case 'n':
+                config.jobs = atoi(optarg);
+                break;
+            case 'r':
+                config.arrival_rate = strtod(optarg, NULL);
+                break;
+            case 'd':
+                if (strcmp(optarg, "fixed") == 0) {
+                    config.distribution = RUNTIME_FIXED;
+                } else if (strcmp(optarg, "uniform") == 0) {
+                    config.distribution = RUNTIME_UNIFORM;
+                } else if (strcmp(optarg, "exp") == 0) {
+                    config.distribution = RUNTIME_EXPONENTIAL;
+                } else {
+                    fprintf(stderr, "Invalid runtime distribution: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                if (!parse_runtime(optarg, &config.mean_runtime)) {
+                    fprintf(stderr, "Invalid mean runtime: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'x':
+                config.cpu_fraction = strtod(optarg, NULL);
+                break;
+            case 'c':
+                config.cpus = atoi(optarg);
+                break;
+            case 'p':
+                config.policies = optarg;
+                break;
+            case 'Q':
+                config.quantum = optarg;
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                config.manager = optarg;
+                break;
+            case 'j':
+                config.prog = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (config.jobs <= 0 || config.arrival_rate < 0 || config.cpu_fraction < 0 || config.cpu_fraction > 1) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    parse_options(argc, argv);
+    // A manager that exits early must not kill the harness on its next request
+    signal(SIGPIPE, SIG_IGN);
+    bench_job * jobs = malloc(config.jobs * sizeof(bench_job));
+    if (jobs == NULL) {
+        perror("Malloc failed in main\n");
+        return EXIT_FAILURE;
+    }
+    generate_workload(jobs);
+    printf("%d jobs, mean runtime %.1fms, %.0f arrivals/s, cpu fraction %.2f, %d CPUs, seed %llu\n", config.jobs,
+           (double) config.mean_runtime / NS_PER_MS, config.arrival_rate, config.cpu_fraction, config.cpus,
+           (unsigned long long) config.seed);
+    printf("%-6s %6s %9s %9s %9s %11s %11s %8s %8s %8s %9s %9s\n", "policy", "jobs", "jobs/s", "wait ms", "wait p99",
+           "turnaround", "turn p99", "SIGSTOP", "SIGCONT", "avoided", "submit us", "submit max");
+    char * policies = strdup(config.policies);
+    bool ok = true;
+    char * saveptr;
+    for (char * policy = strtok_r(policies, ",", &saveptr); policy != NULL; policy = strtok_r(NULL, ",", &saveptr)) {
+        ok = bench_policy(policy, jobs) && ok;
+    }
+    free(policies);
+    free(jobs);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,14 @@
+#!/bin/sh
+GCC="gcc -Wall -Werror -Wextra -Wpedantic -Wstrict-prototypes -std=gnu11 -o "
+BIN="./bin/"
+
+mkdir -p ${BIN}
+
+# The manager is built optimized unless CFLAGS says otherwise, the numbers are meant to be compared across versions
+CFLAGS=${CFLAGS:--O2}
+
+$GCC ${BIN}manager ${CFLAGS} manager.c -pthread -lreadline || exit 1
+$GCC ${BIN}prog -O2 prog.c || exit 1
+$GCC ${BIN}bench -O2 bench.c -lm || exit 1
+
+${BIN}bench "$@"
@@ -7,6 +7,6 @@ clear
 
 rm ${BIN}manager
 
-$GCC ${BIN}manager manager.c -lreadline
+$GCC ${BIN}manager ${CFLAGS} manager.c -pthread -lreadline
 
 ${BIN}manager
\ No newline at end of file
@@ -1,15 +1,40 @@
+#define _GNU_SOURCE
+#include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 /*
     DATA STRUCTURES AND GLOBAL VARIABLES
@@ -21,78 +46,846 @@ typedef enum process_status {
     READY = 1,
     STOPPED = 2,
 	TERMINATED = 3,
-    UNUSED = 4
+    UNUSED = 4,
+    // Submitted but not launched yet (Admission control), waiting in the admission queue under a job id
+    PENDING = 5,
+    // Submitted with run --after and not launched yet, waiting for the jobs it depends on to exit successfully
+    WAITING = 6
 } process_status;
 
-// Process record struct
+// Process record struct (In the SoA layout the hot fields pid, status and remaining runtime live in separate arrays)
 typedef struct process_record {
+#ifndef PROCESS_TABLE_SOA
 	pid_t pid;
 	process_status status;
-    int remaining_runtime;
+    // Remaining runtime budget in nanoseconds
+    int64_t remaining_runtime;
+#endif
+    // Position of the record in the ready queue (-1 when the record is not READY)
+    int heap_position;
+    // Next slot in the free-list the record belongs to while UNUSED or TERMINATED (-1 ends the list)
+    int next_free;
+    // Reading of the accounting clock (ns) up to which a RUNNING process has been charged for its runtime
+    int64_t charged_until;
+    // Runtime charged to the process so far (ns, of the accounting clock)
+    int64_t runtime_used;
+    // Value of change_sequence at the last status change of the record (What watch compares against)
+    uint64_t changed_seq;
+    // CPU-time clock of the process (Used by the cpu accounting mode)
+    clockid_t cpu_clock;
+    // Pidfd of the process until it is reaped (-1 without one), exits and signals go through it
+    int pidfd;
+    // Ready queue key given by the scheduling policy when the record became READY (Smallest runs first)
+    int64_t sched_key;
+    // Feedback queue level of the process (MLFQ policy, 0 is the highest priority)
+    int level;
+    // Set when the time slice of the running process ran out, consumed when it is queued again
+    bool slice_expired;
+    // Cgroup of the job (cgroup backend, -1 without one): directory, cgroup.freeze and cpu.stat, and the cpu.weight
+    // last written (-1 when never written)
+    int cgroup_fd;
+    int cgroup_freeze_fd;
+    int cgroup_stat_fd;
+    int cgroup_weight;
+    // Start time of the process (Clock ticks after boot, from /proc) with a state file: tells a live job from a
+    // recycled pid after a restart
+    int64_t start_time;
+    // Job reattached after a restart of the manager: not our child, its exit is only seen through its pidfd
+    bool adopted;
+    // Launched and not reaped yet (Counted in resident_count)
+    bool resident;
+    // Read end of the pipe the stdout and stderr of the job go to (Output capture, -1 without one or at end of file)
+    int output_fd;
+    // Where the pipe is drained to: the log file of the job or its ring of the buffer pool (-1 without one)
+    int log_fd;
+    int output_ring;
+    // Bytes of output captured so far (A ring holds the last CAPTURE_RING_SIZE of them)
+    uint64_t output_bytes;
+    // Monotonic time (ns) the job was admitted at, and it last became READY at (Turnaround and wait histograms)
+    int64_t admitted_at;
+    int64_t ready_since;
+    // Runtime the synthetic process of a simulation needs to finish (Its budget is only what the scheduler sees)
+    int64_t simulated_work;
+    // History entry of the program of the job (-1 without one) and the key of the program (The entry may be taken over
+    // by another program while the job runs), and the runtime predicted from it (0 for none)
+    int estimate_slot;
+    uint64_t estimate_key;
+    int64_t predicted_runtime;
+    // Job id the job was queued under while PENDING or WAITING (0 for none), it stays an alias of its pid in the pid
+    // index
+    pid_t job_id;
+    // Exit status once reaped: the exit code, or 128 + the signal that killed it (EXIT_STATUS_NONE before,
+    // EXIT_STATUS_UNKNOWN for an adopted job)
+    int exit_status;
+    // Dependencies (run --after): first edge of the list of jobs waiting on this one (-1 ends it), and the number of
+    // jobs a WAITING job still waits for
+    int first_dependent;
+    int unfinished_dependencies;
+    // Critical path (ns) of the job and the path_epoch it was computed in (Memo of critical_path())
+    int64_t critical_path;
+    uint32_t path_epoch;
+    // CPU (Index into cpus) the process runs on or is queued for, and the CPU it is pinned to (-1 if not pinned)
+    int cpu;
+    int pinned_cpu;
 } process_record;
 
-// Maximum number of processes
+// Sizes of the process table: initial number of slots, and the cache line size the arena arrays are aligned to
 enum {
-	MAX_PROCESSES = 64
+	INITIAL_PROCESSES = 64,
+    CACHE_LINE_SIZE = 64
 };
 
+// Units of the nanosecond runtime accounting
+enum {
+    NS_PER_US = 1000,
+    NS_PER_MS = 1000000,
+    NS_PER_SEC = 1000000000
+};
+
+// How READY records are selected: through the indexed min-heap, or by scanning the table (Vectorized in the SoA layout)
+typedef enum ready_queue_mode {
+    READY_QUEUE_HEAP = 0,
+    READY_QUEUE_SCAN = 1
+} ready_queue_mode;
+
+// What runtime is charged to a process: wall-clock time while RUNNING, or the CPU time it actually used
+typedef enum accounting_mode {
+    ACCOUNTING_WALL = 0,
+    ACCOUNTING_CPU = 1
+} accounting_mode;
+
+// How jobs are launched: fork() then exec, or posix_spawn() (vfork-like, no copy of the manager's page tables)
+typedef enum spawn_mode {
+    SPAWN_FORK = 0,
+    SPAWN_POSIX = 1
+} spawn_mode;
+
+// Where the stdout and stderr of the jobs go: inherited from the manager, or through a pipe per job into log files
+// or into in-memory rings
+typedef enum capture_mode {
+    CAPTURE_NONE = 0,
+    CAPTURE_FILES = 1,
+    CAPTURE_MEMORY = 2
+} capture_mode;
+
+// Size of one ring of the capture buffer pool (A power of two, the capacity of a default pipe)
+enum {
+    CAPTURE_RING_SIZE = 65536
+};
+
+// First argument that makes the manager binary act as the spawn-stopped trampoline instead of a manager
+#define SPAWN_STOPPED_ARGUMENT "--spawn-stopped"
+
+// Scheduling policies: which READY process runs next, and whether running processes get a time slice
+typedef enum policy_kind {
+    // Shortest job first, reconsidered whenever a command or an exit reschedules (No time slice)
+    POLICY_SJF = 0,
+    // Shortest remaining time first, also reconsidered at the end of every quantum
+    POLICY_SRTF = 1,
+    // Round-robin in arrival order, one quantum per turn
+    POLICY_RR = 2,
+    // Multi-level feedback queue: a process using its whole slice drops one level, the slice doubling per level
+    POLICY_MLFQ = 3,
+    // Longest critical path first: the job with the most expected runtime ahead of it and its dependents (No time slice)
+    POLICY_CRITICAL_PATH = 4
+} policy_kind;
+
+// Placement of the jobs of a coordinator on its nodes
+typedef enum placement_kind {
+    // The node with the fewest resident and pending jobs
+    PLACEMENT_LEAST_LOADED = 0,
+    // Consistent hashing of the program: the jobs of a program stay on one node while the nodes do not change
+    PLACEMENT_HASH = 1
+} placement_kind;
+
+// Runtime configuration of the manager (Set from the command line)
+typedef struct manager_config {
+    // Maximum number of process records, 0 for no limit
+    int max_processes;
+    ready_queue_mode ready_queue;
+    // Number of processes allowed to run concurrently, one per CPU
+    int cpus;
+    accounting_mode accounting;
+    spawn_mode spawn;
+    // Number of threads launching the jobs of a runbatch in parallel (1 launches them from the main thread)
+    int spawn_workers;
+    policy_kind policy;
+    // Time slice (ns) of the time-sliced policies (The slice of MLFQ level 0)
+    int64_t quantum;
+    // Number of MLFQ levels, and the period (ns) after which every process goes back to level 0
+    int mlfq_levels;
+    int64_t mlfq_boost;
+    // Delegated cgroup v2 directory jobs get their own group in (NULL: jobs are stopped and continued with signals)
+    const char * cgroup;
+    // File the process table is kept in, reattached after a restart (NULL: the table lives on the heap)
+    const char * state_file;
+    // Path of the SOCK_SEQPACKET control socket (NULL: only the user interface pipe)
+    const char * listen_path;
+    // Output capture of the jobs, and the directory of the log files (CAPTURE_FILES)
+    capture_mode capture;
+    const char * capture_dir;
+    // File the statistics are exported to as JSON every stats_interval (ns) (NULL: only the stats command)
+    const char * stats_file;
+    int64_t stats_interval;
+    // Trace replayed by the simulation mode (NULL: manage real processes)
+    const char * simulate_trace;
+    // History file of the runtime estimator (NULL: jobs are ordered by their budgets alone)
+    const char * estimates_file;
+    // Runtime (ns) taken off the sjf/srtf key of a READY record per ns it waits (0: no aging)
+    double aging_rate;
+    // Admission control: most jobs with a live process, most memory (Bytes) they may use, and most of them waiting
+    // to run (0 / 0 / -1: no limit, every job is launched when it is submitted)
+    int max_resident;
+    int64_t max_rss;
+    int prefetch;
+    // Coordinator mode: comma-separated control sockets of the managers commands are forwarded to (NULL: run the jobs
+    // here), and how runs are placed on them
+    const char * coordinator_nodes;
+    placement_kind placement;
+    // Binary journal of the status changes, and the size (Bytes) it is rotated at (NULL: no journal)
+    const char * journal_file;
+    int64_t journal_size;
+} manager_config;
+
+manager_config config = {
+    .max_processes = 0,
+    .ready_queue = READY_QUEUE_HEAP,
+    .cpus = 1,
+    .accounting = ACCOUNTING_WALL,
+    .spawn = SPAWN_POSIX,
+    .spawn_workers = 1,
+    .policy = POLICY_SJF,
+    .quantum = 100000000LL,
+    .mlfq_levels = 3,
+    .mlfq_boost = 1000000000LL,
+    .cgroup = NULL,
+    .state_file = NULL,
+    .listen_path = NULL,
+    .capture = CAPTURE_NONE,
+    .capture_dir = NULL,
+    .stats_file = NULL,
+    .stats_interval = 10000000000LL,
+    .simulate_trace = NULL,
+    .estimates_file = NULL,
+    .aging_rate = 0,
+    .max_resident = 0,
+    .max_rss = 0,
+    .prefetch = -1,
+    .coordinator_nodes = NULL,
+    .placement = PLACEMENT_LEAST_LOADED,
+    .journal_file = NULL,
+    .journal_size = 64LL * 1024 * 1024
+};
+
+// History file of the runtime estimator: this header followed by ESTIMATE_CAPACITY entries, in host byte order
+#define ESTIMATE_FILE_MAGIC 0x31545345474d50ULL
+enum {
+    ESTIMATE_FILE_VERSION = 1,
+    // Entries of the table (A power of two), and how many a program may be placed in from its hash
+    ESTIMATE_CAPACITY = 4096,
+    ESTIMATE_PROBES = 8,
+    // Weight of the latest runtime in the average: 2^-ESTIMATE_SHIFT
+    ESTIMATE_SHIFT = 1
+};
+
+typedef struct estimate_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    // Incremented on every lookup, what the entries record as their last use
+    uint64_t clock;
+} estimate_header;
+
+typedef struct estimate_entry {
+    // Hash of the program path (0 for a free entry)
+    uint64_t key;
+    // Exponential average of the runtimes of the program (ns of the accounting clock)
+    int64_t average;
+    uint32_t samples;
+    // Lower half of the header clock at the last lookup (The least recent entry of a window is replaced)
+    uint32_t last_used;
+} estimate_entry;
+
+estimate_header * estimates = NULL;
+estimate_entry * estimate_entries = NULL;
+
+// Simulation mode: processes are synthetic and monotonic_ns() reads the virtual clock, advanced from event to event
+bool simulating = false;
+int64_t simulated_now = 0;
+
+// Directory the log files of the jobs are created in (CAPTURE_FILES)
+int capture_dir_fd = -1;
+// Buffer pool of the rings (CAPTURE_MEMORY): capture_ring_count rings of CAPTURE_RING_SIZE bytes, and a stack of the
+// free ones (Allocated up front for INITIAL_PROCESSES jobs, doubled when every ring is in use)
+char * capture_pool = NULL;
+int capture_ring_count = 0;
+int * free_rings = NULL;
+int free_ring_count = 0;
+
+// Entry of the pid -> slot index (pid 0 marks an empty entry)
+typedef struct pid_index_entry {
+    pid_t pid;
+    int index;
+} pid_index_entry;
+
+// Open-addressing (Linear probing) hash index from pid to process record slot (A power of two, at most half full)
+pid_index_entry * pid_index;
+int pid_index_mask;
+
+// Per-slot arrays of the process table, as laid out in its arena
+typedef struct process_arrays {
+    process_record * records;
+#ifdef PROCESS_TABLE_SOA
+    pid_t * pids;
+    uint8_t * statuses;
+    int64_t * runtimes;
+#endif
+    pid_index_entry * pid_index;
+} process_arrays;
+
+// Arena holding every per-slot array of the process table, reallocated as a whole when the table grows
+void * process_arena = NULL;
+
+// Header of the state file, followed by the arena at STATE_HEADER_SIZE (A version or layout mismatch cannot reattach)
+#define STATE_FILE_MAGIC 0x3142415444474d50ULL
+enum {
+    STATE_FILE_VERSION = 1,
+    STATE_HEADER_SIZE = 4096
+};
+
+typedef struct state_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t soa;
+    int32_t capacity;
+    int32_t pid_capacity;
+    uint64_t arena_size;
+} state_header;
+
+// Open (And locked) state file the table is mapped from, and the whole mapping (Header first)
+int state_fd = -1;
+char * state_map = NULL;
+size_t state_map_size = 0;
+// State file mapping being filled while the table grows (Becomes the state file in replace_arena)
+int next_state_fd = -1;
+char * next_state_map = NULL;
+size_t next_state_map_size = 0;
+// Set when the table was mapped from an existing state file, its live jobs are reattached once the event loop is up
+bool state_recovered = false;
+// Number of slots currently allocated in the process table
+int process_capacity = 0;
 // Process records array
-process_record process_records[MAX_PROCESSES];
-// Index of the running process for easy access
-int running_process_index = -1;
+process_record * process_records;
+#ifdef PROCESS_TABLE_SOA
+// Structure-of-arrays storage of the hot fields, each array starting on its own cache line
+pid_t * process_pids;
+uint8_t * process_statuses;
+int64_t * process_runtimes;
+// Accessors of the hot fields of the record in a slot (Usable as lvalues in both layouts)
+#define PROCESS_PID(i) (process_pids[i])
+#define PROCESS_STATUS(i) (process_statuses[i])
+#define PROCESS_RUNTIME(i) (process_runtimes[i])
+#else
+#define PROCESS_PID(i) (process_records[i].pid)
+#define PROCESS_STATUS(i) (process_records[i].status)
+#define PROCESS_RUNTIME(i) (process_records[i].remaining_runtime)
+#endif
+// Free-lists of reusable slots: a stack of UNUSED slots and a FIFO of TERMINATED slots (Oldest replaced first)
+int unused_head = -1;
+int terminated_head = -1;
+int terminated_tail = -1;
+// Ready queue: indexed binary min-heap of the slots of READY records, keyed on remaining runtime
+typedef struct ready_queue {
+    int * heap;
+    int size;
+    int capacity;
+} ready_queue;
+
+// A CPU the manager runs processes on: its running process and its own ready queue (Runqueue)
+typedef struct cpu_state {
+    // CPU number processes are pinned to
+    int cpu;
+    // Index of the running process for easy access (-1 when the CPU is idle)
+    int running;
+    // Monotonic time (ns) the time slice of the running process ends at (0 when it has no slice)
+    int64_t slice_end;
+    ready_queue queue;
+} cpu_state;
+
+cpu_state * cpus;
+int cpu_count = 0;
+// Number of CPUs with a running process
+int running_count = 0;
+
+// Admission queue: the PENDING records, ordered by the key of the policy like a ready queue (Its head launches next)
+ready_queue admission_queue;
+// Command line of every PENDING or WAITING slot (NULL otherwise): one allocation holding the argv array and its strings
+char ** * pending_commands = NULL;
+int pending_capacity = 0;
+// Number of jobs with a live process (Launched and not reaped yet), what --max-resident limits
+int resident_count = 0;
+// Job ids are above the largest pid Linux hands out (PID_MAX_LIMIT), so they never name a process
+enum {
+    JOB_ID_BASE = 1 << 30
+};
+pid_t next_job_id = JOB_ID_BASE;
+
+// Exit statuses besides the exit codes and signals of reaped jobs
+enum {
+    EXIT_STATUS_NONE = -1,
+    EXIT_STATUS_UNKNOWN = -2
+};
+
+// Dependency edge of run --after, in the list of the job depended on: the dependent job waits for it to exit
+typedef struct dependency_edge {
+    // Slot and job id of the dependent job (The job id tells it from a later job of a reused slot)
+    int dependent;
+    pid_t job_id;
+    // Next edge of the same list, or of the free-list while unused (-1 ends a list)
+    int next;
+} dependency_edge;
+
+// Pool of dependency edges (Grows geometrically, unused edges are kept in a free-list)
+dependency_edge * dependency_edges = NULL;
+int edge_capacity = 0;
+int free_edge = -1;
+// Incremented whenever the DAG changes, invalidating the memoized critical paths (Never 0, the epoch of a record whose
+// path was never computed)
+uint32_t path_epoch = 1;
+
+
+// Streaming reader for the newline-delimited command pipe (Holds a partial command between reads)
+typedef struct command_reader {
+    char * data;
+    size_t length;
+    size_t capacity;
+} command_reader;
+
+command_reader pipe_reader;
+
+// Growable buffer the machine-readable outputs are built in, then written with a single writev
+typedef struct output_buffer {
+    char * data;
+    size_t length;
+    size_t capacity;
+} output_buffer;
+
+output_buffer snapshot_output;
+
+// A client of the control socket: every request is one message, every response one or more messages (See below)
+typedef struct control_client {
+    // Connected socket (-1 for a free slot)
+    int fd;
+    // Response messages not sent yet, each stored as its uint32_t length followed by its bytes
+    output_buffer pending;
+    size_t sent;
+    // Whether the socket is registered for EPOLLOUT (Only while responses are pending)
+    bool waiting_to_send;
+    // What the last watch of this client reported up to
+    uint64_t watch_sequence;
+} control_client;
+
+control_client * clients = NULL;
+int client_capacity = 0;
+int listen_fd = -1;
+// Client whose request is being executed (-1: replies go to the console, as for the user interface pipe)
+int current_client = -1;
+
+// Header of every response message, followed by length bytes of the command's output (Text, or a binary snapshot)
+typedef struct response_header {
+    // RESPONSE_OK or RESPONSE_ERROR
+    uint16_t status;
+    // RESPONSE_MORE when the next message continues this response
+    uint16_t flags;
+    uint32_t length;
+    // Pid of the process started by run, number of jobs started by runbatch, 0 otherwise
+    int64_t value;
+} response_header;
+
+enum {
+    RESPONSE_OK = 0,
+    RESPONSE_ERROR = 1,
+    RESPONSE_MORE = 1,
+    // Largest payload of one response message (Longer outputs continue in more messages)
+    RESPONSE_CHUNK = 65536 - sizeof(response_header),
+    // Largest request message
+    REQUEST_SIZE_MAX = 4096
+};
+
+// Response being built for the current client
+output_buffer reply_output;
+uint16_t reply_status;
+int64_t reply_value;
+
+// A manager the coordinator forwards commands to, through its control socket
+typedef struct coordinator_node {
+    const char * path;
+    // Connected socket (-1 while disconnected, connected again by the next request)
+    int fd;
+    // Resident and pending jobs the node reported at the last load refresh, and jobs placed on it since
+    int64_t reported_load;
+    int64_t placed;
+    // Requests sent whose responses were not read yet (Forwarded commands are pipelined)
+    int outstanding;
+    // Last response read: status, value and output
+    uint16_t status;
+    int64_t value;
+    output_buffer response;
+} coordinator_node;
+
+coordinator_node * nodes = NULL;
+int node_count = 0;
+
+// Point of the consistent hashing ring (COORDINATOR_RING_POINTS per node, sorted by hash)
+typedef struct ring_point {
+    uint64_t hash;
+    int node;
+} ring_point;
+
+ring_point * hash_ring = NULL;
+int ring_size = 0;
+// Monotonic time (ns) of the last load refresh, requests forwarded and batches they went in (One round trip each)
+int64_t loads_refreshed_at = 0;
+uint64_t requests_forwarded = 0;
+uint64_t forward_batches = 0;
+// Request being forwarded
+output_buffer coordinator_request;
+
+enum {
+    // A job of node n with id r has the id r * COORDINATOR_NODES_MAX + n at the coordinator
+    COORDINATOR_NODES_MAX = 64,
+    COORDINATOR_RING_POINTS = 64,
+    // Most requests in flight to one node, and how long a node may take to answer one
+    COORDINATOR_WINDOW = 256,
+    COORDINATOR_TIMEOUT_SEC = 5,
+    // Age (ns) of the loads at which they are asked again
+    COORDINATOR_LOAD_REFRESH = 1000000000
+};
+
+// Names of the statuses in the text and JSON outputs
+const char * const process_status_names[] = {"RUNNING", "READY", "STOPPED", "TERMINATED", "UNUSED", "PENDING", "WAITING"};
+
+// Incremented on every status change of a record, and the value the last watch reported up to
+uint64_t change_sequence = 0;
+uint64_t watch_sequence = 0;
 
-// Time variables for tracking elapsed time for running process
-time_t start_time;
-time_t elapsed_time; // To calculate how much time has passed since the last update 
+// Binary snapshot (list bin, watch bin): this header followed by count entries, in host byte order
+#define SNAPSHOT_MAGIC 0x54534c50U
+enum {
+    SNAPSHOT_VERSION = 1
+};
+
+typedef struct snapshot_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+    uint32_t reserved;
+    // change_sequence when the snapshot was taken
+    uint64_t sequence;
+} snapshot_header;
+
+typedef struct snapshot_entry {
+    int64_t remaining_ns;
+    int64_t used_ns;
+    uint64_t changed_seq;
+    int32_t pid;
+    int32_t cpu;
+    uint8_t status;
+    uint8_t reserved[7];
+} snapshot_entry;
+
+// Counters of the scheduler, printed by the stats command
+typedef struct scheduler_counters {
+    // Calls of schedule_cpu
+    uint64_t reschedules;
+    // Signals sent to processes, by kind
+    uint64_t stops_sent;
+    uint64_t continues_sent;
+    uint64_t terminates_sent;
+    // Jobs frozen and thawed through their cgroup instead of signals
+    uint64_t freezes;
+    uint64_t thaws;
+    // Signals a reschedule did not send because the running process kept its CPU
+    uint64_t signals_avoided;
+} scheduler_counters;
+
+scheduler_counters scheduler_stats;
+
+// Latency histograms of the manager, all in nanoseconds of the monotonic clock
+typedef enum histogram_id {
+    // From the read of a command (Pipe or socket) to its dispatch, and the execution of the command
+    HISTOGRAM_COMMAND_LATENCY = 0,
+    HISTOGRAM_COMMAND = 1,
+    // Execution of run (The launch of the job included)
+    HISTOGRAM_RUN = 2,
+    // One schedule_cpu call, and the selection of the next process in it (find_min_runtime_process and stealing)
+    HISTOGRAM_SCHEDULE = 3,
+    HISTOGRAM_PICK = 4,
+    // Handling of one batch of events by the main loop
+    HISTOGRAM_LOOP = 5,
+    // Time of a job from READY to RUNNING, and from its admission to its exit
+    HISTOGRAM_WAIT = 6,
+    HISTOGRAM_TURNAROUND = 7,
+    HISTOGRAM_COUNT = 8
+} histogram_id;
+
+// HDR-style log-linear buckets: values below HISTOGRAM_SUB_BUCKETS have a bucket each, every power of two above is
+// split into HISTOGRAM_SUB_BUCKETS buckets (A relative error of at most 1/16), up to INT64_MAX
+enum {
+    HISTOGRAM_SUB_BITS = 4,
+    HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS,
+    HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS
+};
+
+typedef struct latency_histogram {
+    uint64_t count;
+    // Sum (For the mean) and largest of the recorded values
+    uint64_t sum;
+    int64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} latency_histogram;
+
+latency_histogram histograms[HISTOGRAM_COUNT];
+const char * const histogram_names[] = {
+    "command_latency", "command", "run", "schedule", "pick", "loop", "wait", "turnaround"
+};
+
+// Time the commands being executed were read at (Start of their command_latency)
+int64_t command_read_at = 0;
+
+// Sources of events multiplexed by the main loop (stored in the upper half of epoll_event.data.u64)
+typedef enum event_source {
+    EVENT_COMMAND_PIPE = 0,
+    EVENT_SIGNAL = 1,
+    EVENT_TIMER = 2,
+    // Exit of one process, the lower half of the event data holds its slot
+    EVENT_PIDFD = 3,
+    // End of the time slice of a running process
+    EVENT_QUANTUM = 4,
+    // New connection on the control socket
+    EVENT_LISTEN = 5,
+    // Request from (Or room to reply to) a client of the control socket, the lower half holds its slot
+    EVENT_CLIENT = 6,
+    // Output of a job in its capture pipe, the lower half holds its slot
+    EVENT_OUTPUT = 7,
+    // Period of the statistics export
+    EVENT_STATS = 8,
+    EVENT_SOURCES = 9
+} event_source;
+
+// Events handled by the main loop, by source
+uint64_t events_handled[EVENT_SOURCES];
+const char * const event_source_names[] = {
+    "command_pipe", "signal", "timer", "pidfd", "quantum", "listen", "client", "output", "stats"
+};
+
+// File descriptors of the event loop: epoll instance, SIGCHLD signalfd and runtime accounting timerfd
+int epoll_fd = -1;
+int signal_fd = -1;
+int timer_fd = -1;
+// Timerfd of the periodic statistics export (-1 without a stats file)
+int stats_fd = -1;
+// Time slice timerfd, armed for the earliest slice end of all CPUs, and the time it is armed for (0 when disarmed)
+int quantum_fd = -1;
+int64_t quantum_armed_for = 0;
+// Whether the accounting timer is currently armed (Only while a process is running)
+bool accounting_timer_armed = false;
+// Signal mask of the manager before SIGCHLD was blocked, restored in every child before exec
+sigset_t original_signal_mask;
+
+// Journal file: this header followed by count records of capacity, in host byte order (Rotated to FILE.1 when full)
+#define JOURNAL_MAGIC 0x4c4e524a474d50ULL
+enum {
+    JOURNAL_VERSION = 1,
+    // Records of the ring between the main thread and the flusher (A power of two)
+    JOURNAL_RING_RECORDS = 1 << 16,
+    // How long the flusher lets records gather before it copies them to the file
+    JOURNAL_FLUSH_NS = 10000000,
+    // Smallest journal file
+    JOURNAL_SIZE_MIN = 4096
+};
+
+typedef struct journal_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    // Records written so far, and room for them in the file
+    uint64_t count;
+    uint64_t capacity;
+} journal_header;
+
+// One status change of a record: when (Monotonic ns, of the virtual clock in a simulation), of which job, from and to
+// which status, and the remaining runtime budget at that moment
+typedef struct journal_record {
+    int64_t time_ns;
+    int64_t remaining_ns;
+    int32_t pid;
+    // Job id of a job submitted through admission control or run --after (0 for none)
+    int32_t job_id;
+    uint8_t old_status;
+    uint8_t new_status;
+    int16_t cpu;
+    uint32_t reserved;
+} journal_record;
+
+// Single-producer single-consumer ring of records: the main thread appends at head, the flusher thread copies from
+// tail into the mapped file (Each index on its own cache line, the producer rereads tail only when the ring looks full)
+journal_record * journal_ring = NULL;
+_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t journal_head = 0;
+_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t journal_tail = 0;
+_Alignas(CACHE_LINE_SIZE) uint64_t journal_cached_tail = 0;
+// Records lost to a full ring or a file that could not be rotated
+_Atomic uint64_t journal_dropped = 0;
+// Flusher thread: set while it waits for records (A futex word, the producer wakes it), and set to stop it
+atomic_uint journal_idle = 0;
+atomic_bool journal_stop = false;
+pthread_t journal_thread;
+// Open journal file and its mapping (Header first), owned by the flusher while it runs
+int journal_fd = -1;
+char * journal_map = NULL;
 
 /*
     UTILITY FUNCTIONS
 */
 
-// Initialize process records
-void initialise_process_records(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        process_records[i].status = UNUSED;
+// Write the whole buffer to a file descriptor, retrying on short writes
+bool write_all(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Home position of a pid in the pid index (Fibonacci hashing)
+int pid_index_slot(pid_t pid) {
+    return (int) (((uint32_t) pid * 2654435769u) & pid_index_mask);
+}
+
+// Map a pid to its process record slot, replacing any stale mapping left by a reused pid
+void pid_index_insert(pid_t pid, int index) {
+    int slot = pid_index_slot(pid);
+    while (pid_index[slot].pid != 0 && pid_index[slot].pid != pid) {
+        slot = (slot + 1) & pid_index_mask;
     }
+    pid_index[slot].pid = pid;
+    pid_index[slot].index = index;
 }
 
-// Get the index of the first unused process record
-int get_unused_process_index(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_records[i].status == UNUSED) {
-            return i;
+// Get the process record slot of a pid, or -1 if the pid is not managed
+int pid_index_lookup(pid_t pid) {
+    if (pid <= 0) {
+        return -1;
+    }
+    for (int slot = pid_index_slot(pid); pid_index[slot].pid != 0; slot = (slot + 1) & pid_index_mask) {
+        if (pid_index[slot].pid == pid) {
+            return pid_index[slot].index;
         }
     }
     return -1;
 }
 
-// Get the index of the first slot with TERMINATED process (For Replacement Policy)
-int get_terminated_process_index(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_records[i].status == TERMINATED) {
-            return i;
+// Remove the mapping of a pid if it still points to the given slot (A newer record may own the pid by now)
+void pid_index_remove(pid_t pid, int index) {
+    int slot = pid_index_slot(pid);
+    while (pid_index[slot].pid != pid) {
+        if (pid_index[slot].pid == 0 || pid <= 0) {
+            return;
         }
+        slot = (slot + 1) & pid_index_mask;
     }
-    return -1;
+    if (pid_index[slot].index != index) {
+        return;
+    }
+    // Backward shift deletion: move following entries of the probe chain into the hole, so no tombstones are needed
+    int hole = slot;
+    for (int next = (hole + 1) & pid_index_mask; pid_index[next].pid != 0; next = (next + 1) & pid_index_mask) {
+        int home = pid_index_slot(pid_index[next].pid);
+        // The entry can fill the hole only if its home position is not between the hole and itself (Cyclically)
+        if (((next - home) & pid_index_mask) >= ((next - hole) & pid_index_mask)) {
+            pid_index[hole] = pid_index[next];
+            hole = next;
+        }
+    }
+    pid_index[hole].pid = 0;
 }
 
-// Find the index of the process record with minimum remaining runtime
-int find_min_runtime_process(void) {
-    int min_index = -1;
-    int min_runtime = INT_MAX;
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->status == READY) {
-            if (p->remaining_runtime < min_runtime) {
-                min_runtime = p->remaining_runtime;
-                min_index = i;
+// Register a file descriptor with the epoll instance, tagging it with its event source
+void add_event_source(int fd, event_source source, uint32_t id, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = ((uint64_t) source << 32) | id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("Epoll_ctl failed in add_event_source\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Write a whole vector of buffers, resuming after partial writes
+bool writev_all(int fd, struct iovec * iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            return false;
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
         }
     }
-    return min_index;
+    return true;
+}
+
+// Make room for length more bytes in an output buffer
+void output_reserve(output_buffer * output, size_t length) {
+    if (output->length + length <= output->capacity) {
+        return;
+    }
+    size_t capacity = output->capacity == 0 ? 4096 : output->capacity;
+    while (capacity < output->length + length) {
+        capacity *= 2;
+    }
+    char * data = realloc(output->data, capacity);
+    if (data == NULL) {
+        perror("Realloc failed in output_reserve\n");
+        exit(EXIT_FAILURE);
+    }
+    output->data = data;
+    output->capacity = capacity;
+}
+
+// Append formatted text to an output buffer
+void output_printf(output_buffer * output, const char * format, ...) __attribute__((format(printf, 2, 3)));
+void output_printf(output_buffer * output, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    output_reserve(output, length + 1);
+    va_start(args, format);
+    vsnprintf(output->data + output->length, length + 1, format, args);
+    va_end(args);
+    output->length += length;
 }
 
-// Similar to the shell.c get_input function but slightly modified
+// Similar to the shell.c get_input function but slightly modified (Returns NULL for a blank line)
 char * get_input(char * buffer, char * args[], int args_count_max) {
 	for (char* c = buffer; *c != '\0'; ++c) {
 		if ((*c == '\r') || (*c == '\n')) {
@@ -100,7 +893,6 @@ char * get_input(char * buffer, char * args[], int args_count_max) {
 			break;
 		}
 	}
-	strcat(buffer, " ");
 	// Tokenize command's arguments
 	char * p = strtok(buffer, " ");
 	int arg_cnt = 0;
@@ -116,319 +908,5126 @@ char * get_input(char * buffer, char * args[], int args_count_max) {
 }
 
 /*
-    SIGNAL HANDLERS: SIGCHLD (To handle child process termination automatically)
+    CGROUPS (Optional backend: one cgroup v2 group per job, frozen and thawed as a unit)
 */
 
-// Signal handler for SIGCHLD (Child process terminated)
-void sigchld_handler(int signum) {
-    (void) signum;
-    pid_t pid;
-    int status;
-    // Reap all terminated child processes
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        for (int i = 0; i < MAX_PROCESSES; ++i) {
-            // Find the process record with the given pid
-            process_record * const p = &process_records[i];
-            if (p->pid == pid) {
-                // Update the status of the process record
-                p->status = TERMINATED;
-                // If the process was running, update the running process index
-                if (i == running_process_index) {
-                    time_t current_time = time(NULL);
-                    elapsed_time = difftime(current_time, start_time);
-                    if (elapsed_time > 0) {
-                        p->remaining_runtime -= elapsed_time;
-                        start_time = current_time;
-                    }
-                    // Set the running process index to -1 to trigger the scheduler
-                    running_process_index = -1;
-                }
-                break;
-            }
-        }
+// Directory of the delegated cgroup the job groups are created in (-1 without the cgroup backend)
+int cgroup_root_fd = -1;
+
+// Write a value to a file of a cgroup directory
+bool cgroup_write(int dir_fd, const char * file, const char * value) {
+    int fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
     }
+    bool written = write_all(fd, value, strlen(value));
+    close(fd);
+    return written;
+}
+
+// Name of the group of the job in a slot
+void cgroup_name(int index, char * name, size_t size) {
+    snprintf(name, size, "job-%d", (int) PROCESS_PID(index));
 }
 
-// Set up the signal handlers for SIGCHLD (Automatically handle child process termination)
-void setup_signal_handlers(void) {
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    // Block all signals while the handler is running
-    sigemptyset(&sa.sa_mask);
-    // Restart system calls if interrupted by handler
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    // Register the handler for SIGCHLD
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        perror("Sigaction failed in setup_signal_handlers\n");
+// Open the delegated cgroup, enable the cpu controller for the job groups and remove the empty groups of a previous run
+void setup_cgroup_root(void) {
+    cgroup_root_fd = open(config.cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup_root_fd == -1) {
+        perror("Open failed in setup_cgroup_root\n");
         exit(EXIT_FAILURE);
     }
+    // Without the cpu controller jobs still freeze and thaw, they only get no cpu.weight
+    if (!cgroup_write(cgroup_root_fd, "cgroup.subtree_control", "+cpu")) {
+        fprintf(stderr, "Cannot enable the cpu controller in %s, cpu weights are disabled\n", config.cgroup);
+    }
+    DIR * dir = opendir(config.cgroup);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "job-", 4) == 0) {
+            unlinkat(cgroup_root_fd, entry->d_name, AT_REMOVEDIR);
+        }
+    }
+    closedir(dir);
 }
 
-/*
-    SCHEDULER (Placed here to avoid implicit declaration)
-*/
-
-// Scheduler function to start the process with the minimum remaining runtime (SJF)
-void scheduler (void) {
-    // If there is a running process, stop it and update its remaining runtime
-    // Reason to stop the process: To ensure that the process does not consume CPU time while the scheduler is running
-    if (running_process_index >= 0) {
-        process_record * const p = &process_records[running_process_index];
-        int kill_check = kill(p->pid, SIGSTOP);
-        // If the kill fails, print an error message
-        if (kill_check == -1) {
-            perror("First Kill failed in scheduler()\n");
-            return;
-        }
-        time_t current_time = time(NULL);
-        elapsed_time = difftime(current_time, start_time);
-        if (elapsed_time > 0) {
-            p->remaining_runtime -= elapsed_time;
-            start_time = current_time;
+// Move a new job (Still stopped) into a group of its own, returns false if it stays managed by signals
+bool attach_process_cgroup(int index) {
+    process_record * const p = &process_records[index];
+    if (cgroup_root_fd < 0) {
+        return false;
+    }
+    char name[32];
+    cgroup_name(index, name, sizeof(name));
+    if (mkdirat(cgroup_root_fd, name, 0755) == -1 && errno != EEXIST) {
+        perror("Mkdirat failed in attach_process_cgroup\n");
+        return false;
+    }
+    p->cgroup_fd = openat(cgroup_root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    char pid[16];
+    snprintf(pid, sizeof(pid), "%d", (int) PROCESS_PID(index));
+    if (p->cgroup_fd == -1 || !cgroup_write(p->cgroup_fd, "cgroup.procs", pid)) {
+        perror("Joining the cgroup failed in attach_process_cgroup\n");
+        if (p->cgroup_fd >= 0) {
+            close(p->cgroup_fd);
+            p->cgroup_fd = -1;
         }
-        p->status = READY;
-        // Set the running process index to -1 to indicate that there is no running process now
-        running_process_index = -1;
+        unlinkat(cgroup_root_fd, name, AT_REMOVEDIR);
+        return false;
     }
+    // Kept open: freezing, thawing and reading the usage are then a single syscall each
+    p->cgroup_freeze_fd = openat(p->cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC);
+    p->cgroup_stat_fd = openat(p->cgroup_fd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+    p->cgroup_weight = -1;
+    return true;
+}
 
-    // Find the process with the minimum remaining runtime and start it (Scheduler Policy: SJF (Shortest Job First))
-    int min_index = find_min_runtime_process();
-    // If there is no process to start (No READY processes), return
-    if (min_index < 0) {
+// Remove the group of a job whose main process exited (Processes it left behind are killed with the group)
+void detach_process_cgroup(int index) {
+    process_record * const p = &process_records[index];
+    if (p->cgroup_fd < 0) {
         return;
     }
-    // Start the process with the minimum remaining runtime
-    process_record * const p = &process_records[min_index];
-    p->status = RUNNING;
-    running_process_index = min_index;
-    int kill_check = kill(p->pid, SIGCONT);
-    // If the kill fails, print an error message
-    if (kill_check == -1) {
-        perror("Second Kill failed in scheduler()\n");
-        return;
+    char name[32];
+    cgroup_name(index, name, sizeof(name));
+    if (unlinkat(cgroup_root_fd, name, AT_REMOVEDIR) == -1 && errno == EBUSY) {
+        // The empty group is removed at the next start of the manager
+        cgroup_write(p->cgroup_fd, "cgroup.kill", "1");
     }
-    // Update the start time for the new running process
-    start_time = time(NULL);
+    if (p->cgroup_freeze_fd >= 0) {
+        close(p->cgroup_freeze_fd);
+    }
+    if (p->cgroup_stat_fd >= 0) {
+        close(p->cgroup_stat_fd);
+    }
+    close(p->cgroup_fd);
+    p->cgroup_fd = p->cgroup_freeze_fd = p->cgroup_stat_fd = -1;
 }
 
-/*
-    CORE FUNCTIONS: RUN, LIST, STOP, RESUME, TERMINATE and EXIT
-*/
+// Freeze or thaw every process of a job
+bool set_cgroup_frozen(int index, bool frozen) {
+    return pwrite(process_records[index].cgroup_freeze_fd, frozen ? "1" : "0", 1, 0) == 1;
+}
 
-void perform_run(char* args[]) {
-    // Ensure that the arguments are valid
-    if (args == NULL) {
-        fprintf(stderr, "Invalid arguments for perform_run()\n");
-        return;
+// CPU time (ns) used by every process of a job, from usage_usec in cpu.stat (-1 if unavailable)
+int64_t cgroup_cpu_usage_ns(int index) {
+    char buffer[512];
+    ssize_t length = pread(process_records[index].cgroup_stat_fd, buffer, sizeof(buffer) - 1, 0);
+    if (length <= 0) {
+        return -1;
     }
-    // Ensure there are enough arguments
-    if (args[1] == NULL || args[2] == NULL || args[3] == NULL) {
-        fprintf(stderr, "Invalid arguments for perform_run()\n");
-        return;
+    buffer[length] = '\0';
+    const char * usage = strstr(buffer, "usage_usec ");
+    if (usage == NULL) {
+        return -1;
     }
-    // Ensure that the remaining runtime is valid
-    if (atoi(args[3]) <= 0) {
-        fprintf(stderr, "Invalid remaining runtime for perform_run(), provide a number > 0\n");
+    return strtoll(usage + strlen("usage_usec "), NULL, 10) * NS_PER_US;
+}
+
+// Give a job the cpu.weight of the policy (Only written when it changes)
+void set_cgroup_weight(int index, int weight) {
+    process_record * const p = &process_records[index];
+    if (p->cgroup_fd < 0 || p->cgroup_weight == weight) {
         return;
     }
-    // Ensure there is space for the new process record:
-    int index = get_unused_process_index();
-    if (index < 0) {
-        // If there is no unused process record, find the first TERMINATED process record to replace
-        index = get_terminated_process_index();
+    char value[16];
+    snprintf(value, sizeof(value), "%d", weight);
+    // A failed write (No cpu controller) is not retried for this weight
+    cgroup_write(p->cgroup_fd, "cpu.weight", value);
+    p->cgroup_weight = weight;
+}
+
+/*
+    OUTPUT CAPTURE (A pipe per job for its stdout and stderr, drained by the event loop into a log file or a ring)
+*/
+
+// Add rings to the buffer pool until it holds count of them
+bool grow_ring_pool(int count) {
+    // realloc() of a large block remaps its pages, the captured output is not copied
+    char * pool = realloc(capture_pool, (size_t) count * CAPTURE_RING_SIZE);
+    if (pool == NULL) {
+        return false;
     }
-    if (index < 0) {
-        // If there is no TERMINATED process record, print an error message and return
-        fprintf(stderr, "Maximum number of processes reached\n");
-        return;
+    capture_pool = pool;
+    int * rings = realloc(free_rings, count * sizeof(int));
+    if (rings == NULL) {
+        return false;
     }
-
-    // Create a new process to run and store its information in the process records array
-	pid_t pid = fork();
-	if (pid < 0) {
-		fprintf(stderr, "Fork failed in perform_run()\n");
-		return;
-	}
-	if (pid == 0) {
-        // Child process: Execute the command within the new process
-        // Since './' will be present in the input, we can directly execute the command
-		execvp(args[1], args + 1);
-        // If the exec fails, print an error message and exit the child process
-        perror("Execution failed in perform_run()\n");
-		exit(EXIT_FAILURE);
-	}
-    // Parent process: Store the information of the new process in the process records array
-	process_record * const p = &process_records[index];
-	p->pid = pid;
-    // Set the status to READY because the scheduler will decide which process to start
-	p->status = READY;
-    p->remaining_runtime = atoi(args[3]);
-    // Start the process if there is no running process
-    if (running_process_index < 0) {
-        start_time = time(NULL);
-        p->status = RUNNING;
-        running_process_index = index;
-    } else {
-        // If there is a running process already, stop this process and store it as READY
-        int kill_check = kill(p->pid, SIGSTOP);
-        if (kill_check == -1) {
-            perror("Kill failed in perform_run()\n");
-            return;
-        }
+    free_rings = rings;
+    // The new rings are pushed in reverse so the lowest ring is handed out first
+    for (int ring = count - 1; ring >= capture_ring_count; --ring) {
+        free_rings[free_ring_count++] = ring;
     }
-    // We call the scheduler to start the process with the minimum remaining runtime (SJF)
-    scheduler();
+    capture_ring_count = count;
+    return true;
 }
 
-void perform_list(void) {
-    // To keep track of whether there are any non-UNUSED processes
-    bool found = false;
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->status != UNUSED) {
-            found = true;
-            printf("%d, %d\n", p->pid, p->status);
+// Open the directory of the log files, or allocate the buffer pool of the rings
+void setup_capture(void) {
+    if (config.capture == CAPTURE_FILES) {
+        capture_dir_fd = open(config.capture_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (capture_dir_fd == -1) {
+            perror("Open failed in setup_capture()\n");
+            exit(EXIT_FAILURE);
         }
-    }
-    if (!found) {
-        printf("No processes to list.\n");
+    } else if (config.capture == CAPTURE_MEMORY && !grow_ring_pool(INITIAL_PROCESSES)) {
+        perror("Allocation failed in setup_capture()\n");
+        exit(EXIT_FAILURE);
     }
 }
 
-void perform_stop(pid_t pid) {
-    // Ensure that the process ID given is valid
-    if (pid <= 0) {
-        printf("The process ID must be a positive integer.\n");
-        return;
+// Name of the log file of a job in the capture directory
+void log_file_name(pid_t pid, char * name, size_t size) {
+    snprintf(name, size, "job-%d.log", (int) pid);
+}
+
+// Create the pipe of a job about to be launched: returns the write end the job gets as stdout and stderr and stores
+// the read end (-1 for both without capture, the job then inherits the output of the manager)
+int open_output_pipe(int * read_end) {
+    *read_end = -1;
+    if (config.capture == CAPTURE_NONE) {
+        return -1;
     }
-    // Find the process record with the given PID and stop it if it is RUNNING
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->pid == pid) {
-            if (p->status == RUNNING || p->status == READY) {
-                int kill_check = kill(p->pid, SIGSTOP);
-                // If the kill fails, print an error message
-                if (kill_check == -1) {
-                    perror("Kill failed in perform_stop()\n");
-                    return;
-                }
-                p->status = STOPPED;
-                // If the process was running, update information about the running process
-                if (i == running_process_index) {
-                    // Update the remaining runtime of the process to ensure (Scheduler Policy: SJF)
-                    time_t current_time = time(NULL);
-                    elapsed_time = difftime(current_time, start_time);
-                    if (elapsed_time > 0) {
-                        p->remaining_runtime -= elapsed_time;
-                        start_time = current_time;
-                    }
-                    // Set the running process index to -1 to trigger the scheduler
-                    running_process_index = -1;
-                    scheduler();
-                }
-                return;
-            } else {
-                // If the process is not running, print an error message
-                printf("Process %d is not running.\n", pid);
-                return;
-            }
-        }
+    int fds[2];
+    // Both ends close on exec, only the job gets the write end (Duplicated onto its stdout and stderr by the launch)
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("Pipe2 failed in open_output_pipe()\n");
+        return -1;
     }
-    // At this point, the process with the given PID was not found
-    printf("Process %d not found.\n", pid);
+    // Only the end of the manager is non-blocking, a job writing faster than it is drained just waits
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    *read_end = fds[0];
+    return fds[1];
 }
 
-void perform_resume(pid_t pid) {
-    // Ensure that the process ID given is valid
-    if (pid <= 0) {
-        printf("The process ID must be a positive integer.\n");
+// Give a newly admitted job its log file or ring and watch the read end of its pipe (Taken over by the record)
+void attach_output(int index, int read_end) {
+    process_record * const p = &process_records[index];
+    p->output_bytes = 0;
+    if (read_end < 0) {
         return;
     }
-    // Find the process record with the given PID and resume it if it is STOPPED
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->pid == pid) {
-            if (p->status == STOPPED) {
-                // We won't directly resume the process here because the scheduler will decide which process to start
-                p->status = READY;
-                scheduler();
-                return;
-            } else {
-                // If the process wasn't not stopped, print an error message
-                printf("Process %d was not in STOPPED status, in order to resume it.\n", pid);
-                return;
-            }
+    if (config.capture == CAPTURE_FILES) {
+        char name[32];
+        log_file_name(PROCESS_PID(index), name, sizeof(name));
+        // Not O_APPEND, splice() refuses a file opened for appending (The file position advances all the same)
+        p->log_fd = openat(capture_dir_fd, name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (p->log_fd == -1) {
+            perror("Openat failed in attach_output()\n");
         }
+    } else if (free_ring_count > 0 || grow_ring_pool(capture_ring_count * 2)) {
+        p->output_ring = free_rings[--free_ring_count];
+    } else {
+        perror("Allocation failed in attach_output()\n");
     }
-    // At this point, the process with the given PID was not found
-    printf("Process %d not found.\n", pid);
+    // Without a destination the pipe is still drained (And its output dropped), the job must not get EPIPE
+    p->output_fd = read_end;
+    add_event_source(read_end, EVENT_OUTPUT, index, EPOLLIN);
 }
 
-void perform_kill(pid_t pid) {
-    // Ensure that the process ID given is valid
-    if (pid <= 0) {
-        printf("The process ID must be a positive integer.\n");
-        return;
-    }
-    // Find the process record with the given PID and terminate it if it is not TERMINATED
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->pid == pid) {
-            if (p->status != TERMINATED) {
-                int kill_check = kill(p->pid, SIGTERM);
-                // If the kill fails, print an error message
-                if (kill_check == -1) {
-                    perror("Kill failed in perform_kill()\n");
-                    return;
-                }
-                p->status = TERMINATED;
-                // If the process was running, update the running process index just for accuracy purposes
-                time_t current_time = time(NULL);
-                elapsed_time = difftime(current_time, start_time);
-                if (elapsed_time > 0) {
-                    p->remaining_runtime -= elapsed_time;
-                    start_time = current_time;
-                }
-                if (i == running_process_index) {
-                    // If the process was running, set the running process index to -1 to trigger the scheduler
-                    running_process_index = -1;
-                    scheduler();
-                }
-                return;
-            } else {
-                printf("Process %d is already terminated.\n", pid);
-                return;
+// Move what is buffered in the pipe of a job to its log file (splice(), no copy through the manager) or its ring
+// At most a few pipe buffers per call, a job that never stops writing must not starve the other events
+void drain_output(int index) {
+    process_record * const p = &process_records[index];
+    for (int round = 0; round < 16 && p->output_fd >= 0; ++round) {
+        ssize_t moved;
+        if (p->log_fd >= 0) {
+            moved = splice(p->output_fd, NULL, p->log_fd, NULL, CAPTURE_RING_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved == -1 && errno != EAGAIN && errno != EINTR) {
+                // The log file cannot take more output (e.g. ENOSPC): keep what it has, drop the rest
+                perror("Splice failed in drain_output()\n");
+                close(p->log_fd);
+                p->log_fd = -1;
+                continue;
             }
+        } else if (p->output_ring >= 0) {
+            // Read straight into the ring: from the write position to its end, then over the oldest output
+            char * const ring = capture_pool + (size_t) p->output_ring * CAPTURE_RING_SIZE;
+            size_t head = p->output_bytes % CAPTURE_RING_SIZE;
+            struct iovec iov[2] = {{ring + head, CAPTURE_RING_SIZE - head}, {ring, head}};
+            moved = readv(p->output_fd, iov, head > 0 ? 2 : 1);
+        } else {
+            char discarded[4096];
+            moved = read(p->output_fd, discarded, sizeof(discarded));
+        }
+        if (moved > 0) {
+            p->output_bytes += moved;
+            continue;
         }
+        if (moved == -1 && errno == EINTR) {
+            continue;
+        }
+        if (moved == -1 && errno == EAGAIN) {
+            return;
+        }
+        // End of file (Every writer is gone) or a broken pipe: stop watching it, the log file or ring stays readable
+        close(p->output_fd);
+        p->output_fd = -1;
     }
-    // At this point, the process with the given PID was not found
-    printf("Process %d not found.\n", pid);
 }
 
-void perform_exit(void) {
-    // Loop through process records and terminate all processes
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        process_record * const p = &process_records[i];
-        if (p->status != UNUSED && p->status != TERMINATED) {
-            int kill_check = kill(p->pid, SIGTERM);
-            // If the kill fails, print an error message
-            if (kill_check == -1) {
-                perror("Kill failed in perform_exit()... continuing exit function\n");
-            }
-            p->status = TERMINATED;
-        }
+// Close the pipe and log file of a job and give its ring back to the pool (When its slot is reused)
+void release_output(int index) {
+    process_record * const p = &process_records[index];
+    if (p->output_fd >= 0) {
+        close(p->output_fd);
+        p->output_fd = -1;
+    }
+    if (p->log_fd >= 0) {
+        close(p->log_fd);
+        p->log_fd = -1;
+    }
+    if (p->output_ring >= 0) {
+        free_rings[free_ring_count++] = p->output_ring;
+        p->output_ring = -1;
     }
-    // Print a message and exit the program
-	printf("Exiting the process manager!\n");
 }
 
 /*
-    MAIN FUNCTION (Entry point of the program)
+    ACCOUNTING (Runtime charged in CLOCK_MONOTONIC nanoseconds)
 */
 
-int main(void) {
-    // First, initialize the process records to UNUSED status
+// Current time of the monotonic clock in nanoseconds
+int64_t monotonic_ns(void) {
+    if (simulating) {
+        return simulated_now;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Convert a timeval (As found in struct rusage) to nanoseconds
+int64_t timeval_ns(struct timeval time) {
+    return (int64_t) time.tv_sec * NS_PER_SEC + (int64_t) time.tv_usec * NS_PER_US;
+}
+
+// Reading of the accounting clock of a process in nanoseconds: monotonic time, or its CPU time (-1 once it is gone)
+int64_t process_clock_ns(int index) {
+    if (config.accounting == ACCOUNTING_WALL) {
+        return monotonic_ns();
+    }
+    if (process_records[index].cgroup_stat_fd >= 0) {
+        // The whole job, including the processes it forked
+        return cgroup_cpu_usage_ns(index);
+    }
+    struct timespec now;
+    if (clock_gettime(process_records[index].cpu_clock, &now) == -1) {
+        return -1;
+    }
+    return (int64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Prepare the accounting of a newly created process
+void setup_accounting(int index) {
+    if (config.accounting == ACCOUNTING_CPU && clock_getcpuclockid(PROCESS_PID(index), &process_records[index].cpu_clock) != 0) {
+        // Leaves the process uncharged (cpu mode only), process_clock_ns() keeps failing for an invalid clock
+        fprintf(stderr, "Clock_getcpuclockid failed for process %d\n", PROCESS_PID(index));
+        process_records[index].cpu_clock = (clockid_t) -1;
+    }
+}
+
+// Start charging a process that just became RUNNING
+void start_charging(int index) {
+    process_records[index].charged_until = process_clock_ns(index);
+}
+
+// Charge a RUNNING process for the time since it was last charged (Every transition off a CPU calls this first)
+void charge_process(int index) {
+    if (PROCESS_STATUS(index) != RUNNING) {
+        return;
+    }
+    process_record * const p = &process_records[index];
+    int64_t now = process_clock_ns(index);
+    if (now < 0 || p->charged_until < 0) {
+        // The process is gone, reaping charges what is left from its resource usage
+        return;
+    }
+    PROCESS_RUNTIME(index) -= now - p->charged_until;
+    p->runtime_used += now - p->charged_until;
+    p->charged_until = now;
+}
+
+// Charge a RUNNING process that just exited, in cpu mode from the total CPU time reported when it was reaped
+void charge_exited_process(int index, const struct rusage * usage) {
+    if (config.accounting == ACCOUNTING_WALL) {
+        charge_process(index);
+        return;
+    }
+    process_record * const p = &process_records[index];
+    int64_t total;
+    if (p->cgroup_stat_fd >= 0) {
+        total = cgroup_cpu_usage_ns(index);
+    } else if (usage != NULL) {
+        total = timeval_ns(usage->ru_utime) + timeval_ns(usage->ru_stime);
+    } else {
+        // A job adopted after a restart leaves no resource usage to the manager
+        return;
+    }
+    if (PROCESS_STATUS(index) == RUNNING && p->charged_until >= 0 && total > p->charged_until) {
+        PROCESS_RUNTIME(index) -= total - p->charged_until;
+        p->runtime_used += total - p->charged_until;
+        p->charged_until = total;
+    }
+}
+
+// Parse a runtime budget: a positive number with an optional unit ns, us, ms, s (Default) or m, e.g. 250ms or 1.5
+bool parse_runtime(const char * text, int64_t * runtime) {
+    char * unit;
+    errno = 0;
+    double value = strtod(text, &unit);
+    if (unit == text || errno != 0 || !(value > 0)) {
+        return false;
+    }
+    double scale;
+    if (*unit == '\0' || strcmp(unit, "s") == 0) {
+        scale = NS_PER_SEC;
+    } else if (strcmp(unit, "ms") == 0) {
+        scale = NS_PER_MS;
+    } else if (strcmp(unit, "us") == 0) {
+        scale = NS_PER_US;
+    } else if (strcmp(unit, "ns") == 0) {
+        scale = 1;
+    } else if (strcmp(unit, "m") == 0) {
+        scale = 60.0 * NS_PER_SEC;
+    } else {
+        return false;
+    }
+    // Keep far enough from the limit that charging can never overflow
+    if (value * scale >= (double) (INT64_MAX / 2) || value * scale < 1) {
+        return false;
+    }
+    *runtime = (int64_t) (value * scale);
+    return true;
+}
+
+// Parse a memory size: a positive number of bytes with an optional binary unit K, M or G, e.g. 512M
+bool parse_size(const char * text, int64_t * size) {
+    char * unit;
+    errno = 0;
+    double value = strtod(text, &unit);
+    if (unit == text || errno != 0 || !(value > 0)) {
+        return false;
+    }
+    double scale;
+    if (*unit == '\0') {
+        scale = 1;
+    } else if (strcmp(unit, "K") == 0) {
+        scale = 1024.0;
+    } else if (strcmp(unit, "M") == 0) {
+        scale = 1024.0 * 1024;
+    } else if (strcmp(unit, "G") == 0) {
+        scale = 1024.0 * 1024 * 1024;
+    } else {
+        return false;
+    }
+    if (value * scale >= (double) INT64_MAX || value * scale < 1) {
+        return false;
+    }
+    *size = (int64_t) (value * scale);
+    return true;
+}
+
+/*
+    INSTRUMENTATION (Counters and latency histograms of the hot paths, printed by stats and exported periodically)
+*/
+
+// Bucket of a value: its power of two and its next HISTOGRAM_SUB_BITS bits
+int histogram_bucket(int64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value < 0 ? 0 : (int) value;
+    }
+    int exponent = 63 - __builtin_clzll((uint64_t) value);
+    int shift = exponent - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (int) ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+// Largest value that falls into a bucket
+int64_t histogram_bucket_limit(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    int64_t sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return (int64_t) (((uint64_t) (sub_bucket + 1) << shift) - 1);
+}
+
+// Add a value to a histogram (No allocation, a few instructions besides the clock reads of the caller)
+void histogram_record(histogram_id id, int64_t value) {
+    latency_histogram * const h = &histograms[id];
+    if (value < 0) {
+        value = 0;
+    }
+    h->count++;
+    h->sum += (uint64_t) value;
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->buckets[histogram_bucket(value)]++;
+}
+
+// Record the time elapsed since start and return the current time (For back to back measurements)
+int64_t histogram_record_since(histogram_id id, int64_t start) {
+    int64_t now = monotonic_ns();
+    histogram_record(id, now - start);
+    return now;
+}
+
+// Value below which a fraction of the recorded values lie (Upper limit of its bucket, at most the largest value)
+int64_t histogram_percentile(const latency_histogram * h, double fraction) {
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (fraction * (double) h->count);
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) {
+        seen += h->buckets[bucket];
+        if (seen > rank) {
+            int64_t limit = histogram_bucket_limit(bucket);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Clear every counter and histogram (stats reset)
+void reset_statistics(void) {
+    memset(&scheduler_stats, 0, sizeof(scheduler_stats));
+    memset(histograms, 0, sizeof(histograms));
+    memset(events_handled, 0, sizeof(events_handled));
+}
+
+// Append the statistics as one JSON object (stats json and the export file)
+void format_statistics_json(output_buffer * output) {
+    output_printf(output, "{\"time_ns\":%lld,\"gauges\":{\"running\":%d,\"resident\":%d,\"pending\":%d},\"counters\":{",
+                  (long long) monotonic_ns(), running_count, resident_count, admission_queue.size);
+    output_printf(output, "\"reschedules\":%llu,\"stops_sent\":%llu,\"continues_sent\":%llu,\"terminates_sent\":%llu,"
+                  "\"freezes\":%llu,\"thaws\":%llu,\"signals_avoided\":%llu,\"journal_records\":%llu,"
+                  "\"journal_dropped\":%llu},\"events\":{",
+                  (unsigned long long) scheduler_stats.reschedules, (unsigned long long) scheduler_stats.stops_sent,
+                  (unsigned long long) scheduler_stats.continues_sent,
+                  (unsigned long long) scheduler_stats.terminates_sent, (unsigned long long) scheduler_stats.freezes,
+                  (unsigned long long) scheduler_stats.thaws, (unsigned long long) scheduler_stats.signals_avoided,
+                  (unsigned long long) atomic_load_explicit(&journal_head, memory_order_relaxed),
+                  (unsigned long long) atomic_load_explicit(&journal_dropped, memory_order_relaxed));
+    for (int source = 0; source < EVENT_SOURCES; ++source) {
+        output_printf(output, "%s\"%s\":%llu", source > 0 ? "," : "", event_source_names[source],
+                      (unsigned long long) events_handled[source]);
+    }
+    output_printf(output, "},\"histograms\":{");
+    for (int id = 0; id < HISTOGRAM_COUNT; ++id) {
+        const latency_histogram * const h = &histograms[id];
+        output_printf(output, "%s\"%s\":{\"count\":%llu,\"mean_ns\":%llu,\"p50_ns\":%lld,\"p90_ns\":%lld,"
+                      "\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld}",
+                      id > 0 ? "," : "", histogram_names[id], (unsigned long long) h->count,
+                      (unsigned long long) (h->count > 0 ? h->sum / h->count : 0),
+                      (long long) histogram_percentile(h, 0.5), (long long) histogram_percentile(h, 0.9),
+                      (long long) histogram_percentile(h, 0.99), (long long) histogram_percentile(h, 0.999),
+                      (long long) h->max);
+    }
+    output_printf(output, "}}\n");
+}
+
+// Replace the export file with the current statistics (Written next to it, then renamed: readers never see half)
+void export_statistics(void) {
+    uint64_t expirations;
+    // Consume the timer expirations, missed periods are not made up for
+    while (read(stats_fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR) {
+    }
+    output_buffer * const output = &snapshot_output;
+    output->length = 0;
+    format_statistics_json(output);
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.new", config.stats_file);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("Open failed in export_statistics()\n");
+        return;
+    }
+    bool written = write_all(fd, output->data, output->length);
+    close(fd);
+    if (!written || rename(path, config.stats_file) == -1) {
+        perror("Export failed in export_statistics()\n");
+        unlink(path);
+    }
+}
+
+/*
+    JOURNAL (Fixed-size binary record of every status change, copied to a rotating mapped file by a flusher thread)
+*/
+
+// Record a status change of a slot (Main thread only: a few stores into the ring, dropped when the ring is full)
+void journal_transition(int index, process_status old_status, process_status new_status) {
+    if (journal_ring == NULL) {
+        return;
+    }
+    const uint64_t head = atomic_load_explicit(&journal_head, memory_order_relaxed);
+    if (head - journal_cached_tail == JOURNAL_RING_RECORDS) {
+        journal_cached_tail = atomic_load_explicit(&journal_tail, memory_order_acquire);
+        if (head - journal_cached_tail == JOURNAL_RING_RECORDS) {
+            atomic_fetch_add_explicit(&journal_dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    journal_record * const record = &journal_ring[head & (JOURNAL_RING_RECORDS - 1)];
+    record->time_ns = monotonic_ns();
+    record->remaining_ns = PROCESS_RUNTIME(index);
+    record->pid = PROCESS_PID(index);
+    record->job_id = process_records[index].job_id;
+    record->old_status = (uint8_t) old_status;
+    record->new_status = (uint8_t) new_status;
+    record->cpu = (int16_t) process_records[index].cpu;
+    record->reserved = 0;
+    // Publish the record, then wake the flusher if it went to sleep on an empty ring. Both sides store then load, all
+    // seq_cst (No lost wakeup): either the flusher sees the new head, or this load sees journal_idle set
+    atomic_store(&journal_head, head + 1);
+    if (atomic_load(&journal_idle) != 0 && atomic_exchange(&journal_idle, 0) != 0) {
+        syscall(SYS_futex, &journal_idle, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// Create the journal file at its full size and map it, returns false on failure
+bool open_journal_file(void) {
+    int fd = open(config.journal_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("Open failed in open_journal_file()\n");
+        return false;
+    }
+    if (ftruncate(fd, config.journal_size) == -1) {
+        perror("Ftruncate failed in open_journal_file()\n");
+        close(fd);
+        return false;
+    }
+    void * map = mmap(NULL, config.journal_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Mmap failed in open_journal_file()\n");
+        close(fd);
+        return false;
+    }
+    journal_header * const header = map;
+    header->magic = JOURNAL_MAGIC;
+    header->version = JOURNAL_VERSION;
+    header->record_size = sizeof(journal_record);
+    header->count = 0;
+    header->capacity = (config.journal_size - sizeof(journal_header)) / sizeof(journal_record);
+    journal_fd = fd;
+    journal_map = map;
+    return true;
+}
+
+// Unmap the journal file and cut it after its last record
+void finish_journal_file(void) {
+    if (journal_map == NULL) {
+        return;
+    }
+    off_t size = sizeof(journal_header) + ((journal_header *) journal_map)->count * sizeof(journal_record);
+    munmap(journal_map, config.journal_size);
+    if (ftruncate(journal_fd, size) == -1) {
+        perror("Ftruncate failed in finish_journal_file()\n");
+    }
+    close(journal_fd);
+    journal_map = NULL;
+    journal_fd = -1;
+}
+
+// Keep the journal file as FILE.1 (Replacing the previous one) and start a new one, returns false on failure
+bool rotate_journal(void) {
+    finish_journal_file();
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.1", config.journal_file);
+    if (rename(config.journal_file, path) == -1) {
+        perror("Rename failed in rotate_journal()\n");
+        return false;
+    }
+    return open_journal_file();
+}
+
+// Copy the records of the ring to the file, rotating it whenever it is full, returns how many were taken (Flusher)
+uint64_t drain_journal(void) {
+    const uint64_t start = atomic_load_explicit(&journal_tail, memory_order_relaxed);
+    const uint64_t head = atomic_load_explicit(&journal_head, memory_order_acquire);
+    uint64_t tail = start;
+    while (tail < head) {
+        journal_header * header = (journal_header *) journal_map;
+        if (header != NULL && header->count == header->capacity && !rotate_journal()) {
+            header = NULL;
+        }
+        if (header == NULL) {
+            // No file to write to any more, the records are lost
+            atomic_fetch_add_explicit(&journal_dropped, head - tail, memory_order_relaxed);
+            tail = head;
+            break;
+        }
+        header = (journal_header *) journal_map;
+        // Up to the end of the ring or of the file, whichever comes first
+        const uint64_t offset = tail & (JOURNAL_RING_RECORDS - 1);
+        uint64_t chunk = head - tail;
+        if (chunk > JOURNAL_RING_RECORDS - offset) {
+            chunk = JOURNAL_RING_RECORDS - offset;
+        }
+        if (chunk > header->capacity - header->count) {
+            chunk = header->capacity - header->count;
+        }
+        memcpy(journal_map + sizeof(journal_header) + header->count * sizeof(journal_record), &journal_ring[offset],
+               chunk * sizeof(journal_record));
+        header->count += chunk;
+        tail += chunk;
+        // The slots go back to the producer as soon as they are copied
+        atomic_store_explicit(&journal_tail, tail, memory_order_release);
+    }
+    atomic_store_explicit(&journal_tail, tail, memory_order_release);
+    return tail - start;
+}
+
+// Flusher thread: drains the ring every JOURNAL_FLUSH_NS while records come in (Right away again after a quarter of
+// the ring or more), sleeps on a futex while none do
+void * journal_flusher(void * argument) {
+    (void) argument;
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = JOURNAL_FLUSH_NS};
+    while (true) {
+        // Read before the drain, so whatever was appended before close_journal() still gets written
+        bool stopping = atomic_load(&journal_stop);
+        uint64_t drained = drain_journal();
+        if (stopping) {
+            break;
+        }
+        if (drained >= JOURNAL_RING_RECORDS / 4) {
+            continue;
+        }
+        nanosleep(&delay, NULL);
+        if (atomic_load(&journal_head) == atomic_load_explicit(&journal_tail, memory_order_relaxed)) {
+            // Announce the wait, then check again: an append in between sees journal_idle set and wakes the thread
+            atomic_store(&journal_idle, 1);
+            if (atomic_load(&journal_head) == atomic_load_explicit(&journal_tail, memory_order_relaxed) &&
+                !atomic_load(&journal_stop)) {
+                syscall(SYS_futex, &journal_idle, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+            }
+            atomic_store(&journal_idle, 0);
+        }
+    }
+    return NULL;
+}
+
+// Open the journal (The one of a previous run is kept as FILE.1) and start the flusher thread
+void setup_journal(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.1", config.journal_file);
+    if (rename(config.journal_file, path) == -1 && errno != ENOENT) {
+        perror("Rename failed in setup_journal()\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!open_journal_file()) {
+        exit(EXIT_FAILURE);
+    }
+    journal_ring = aligned_alloc(CACHE_LINE_SIZE, JOURNAL_RING_RECORDS * sizeof(journal_record));
+    if (journal_ring == NULL) {
+        perror("Aligned_alloc failed in setup_journal()\n");
+        exit(EXIT_FAILURE);
+    }
+    // The thread starts with every signal blocked, they stay with the main thread (SIGCHLD goes to its signalfd)
+    sigset_t all_signals;
+    sigset_t mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &mask);
+    int error = pthread_create(&journal_thread, NULL, journal_flusher, NULL);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    if (error != 0) {
+        errno = error;
+        perror("Pthread_create failed in setup_journal()\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stop the flusher once it has written every record, and cut the journal file after the last one
+void close_journal(void) {
+    if (journal_ring == NULL) {
+        return;
+    }
+    atomic_store(&journal_stop, true);
+    atomic_store(&journal_idle, 0);
+    syscall(SYS_futex, &journal_idle, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_join(journal_thread, NULL);
+    finish_journal_file();
+    free(journal_ring);
+    journal_ring = NULL;
+}
+
+/*
+    PROCESS TABLE (Arena-backed, grows geometrically, O(1) slot allocation through free-lists)
+*/
+
+// Round a size up to a whole number of cache lines
+size_t cache_align(size_t size) {
+    return (size + CACHE_LINE_SIZE - 1) & ~((size_t) CACHE_LINE_SIZE - 1);
+}
+
+// Smallest power of two holding four times the given number of slots (A slot has up to two entries, its pid and its
+// job id, so the pid index stays at most half full)
+int pid_index_capacity_for(int capacity) {
+    int pid_capacity = 1;
+    while (pid_capacity < 4 * capacity) {
+        pid_capacity *= 2;
+    }
+    return pid_capacity;
+}
+
+// Reserve a cache-aligned array in an arena being laid out (A NULL arena only computes the size)
+void * arena_carve(char * arena, size_t * offset, size_t size) {
+    void * array = arena != NULL ? arena + *offset : NULL;
+    *offset += cache_align(size);
+    return array;
+}
+
+// Lay out every per-slot array of a table with the given capacity in an arena, returns the size of the arena
+size_t layout_process_arena(char * arena, int capacity, int pid_capacity, process_arrays * arrays) {
+    size_t offset = 0;
+    arrays->records = arena_carve(arena, &offset, capacity * sizeof(process_record));
+#ifdef PROCESS_TABLE_SOA
+    arrays->pids = arena_carve(arena, &offset, capacity * sizeof(pid_t));
+    arrays->statuses = arena_carve(arena, &offset, capacity * sizeof(uint8_t));
+    arrays->runtimes = arena_carve(arena, &offset, capacity * sizeof(int64_t));
+#endif
+    arrays->pid_index = arena_carve(arena, &offset, pid_capacity * sizeof(pid_index_entry));
+    return offset;
+}
+
+// Header of the state file of a table with the given layout
+void fill_state_header(state_header * header, int capacity, int pid_capacity, size_t arena_size) {
+    memset(header, 0, sizeof(*header));
+    header->magic = STATE_FILE_MAGIC;
+    header->version = STATE_FILE_VERSION;
+    header->record_size = sizeof(process_record);
+#ifdef PROCESS_TABLE_SOA
+    header->soa = 1;
+#endif
+    header->capacity = capacity;
+    header->pid_capacity = pid_capacity;
+    header->arena_size = arena_size;
+}
+
+// Path of the state file being written while the table grows (Renamed over the state file once complete)
+void next_state_path(char * path, size_t size) {
+    snprintf(path, size, "%s.new", config.state_file);
+}
+
+// Allocate an arena: on the heap, or in a new shared file mapping when the table is kept in a state file
+char * allocate_arena(int capacity, int pid_capacity, size_t size) {
+    if (config.state_file == NULL) {
+        return aligned_alloc(CACHE_LINE_SIZE, size);
+    }
+    char path[PATH_MAX];
+    next_state_path(path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    size_t map_size = STATE_HEADER_SIZE + size;
+    char * map = MAP_FAILED;
+    if (ftruncate(fd, map_size) == 0) {
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED || flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        if (map != MAP_FAILED) {
+            munmap(map, map_size);
+        }
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    fill_state_header((state_header *) map, capacity, pid_capacity, size);
+    // Swapped in by replace_arena(), the old mapping stays readable until the records are copied
+    next_state_fd = fd;
+    next_state_map = map;
+    next_state_map_size = map_size;
+    return map + STATE_HEADER_SIZE;
+}
+
+// Free the previous arena once the table lives in a new one (A new state file replaces the old one atomically)
+void replace_arena(void * old_arena) {
+    if (config.state_file == NULL) {
+        free(old_arena);
+        return;
+    }
+    char path[PATH_MAX];
+    next_state_path(path, sizeof(path));
+    if (rename(path, config.state_file) == -1) {
+        perror("Rename failed in replace_arena\n");
+    }
+    if (state_map != NULL) {
+        munmap(state_map, state_map_size);
+        close(state_fd);
+    }
+    state_fd = next_state_fd;
+    state_map = next_state_map;
+    state_map_size = next_state_map_size;
+}
+
+// Grow the process table to a new number of slots: allocate a bigger arena, copy the records and rebuild the pid index
+bool grow_process_table(int capacity) {
+    int pid_capacity = pid_index_capacity_for(capacity);
+    process_arrays arrays;
+    char * arena = allocate_arena(capacity, pid_capacity, layout_process_arena(NULL, capacity, pid_capacity, &arrays));
+    if (arena == NULL) {
+        return false;
+    }
+    layout_process_arena(arena, capacity, pid_capacity, &arrays);
+    memset(arrays.pid_index, 0, pid_capacity * sizeof(pid_index_entry));
+    if (process_capacity > 0) {
+        memcpy(arrays.records, process_records, process_capacity * sizeof(process_record));
+#ifdef PROCESS_TABLE_SOA
+        memcpy(arrays.pids, process_pids, process_capacity * sizeof(pid_t));
+        memcpy(arrays.statuses, process_statuses, process_capacity * sizeof(uint8_t));
+        memcpy(arrays.runtimes, process_runtimes, process_capacity * sizeof(int64_t));
+#endif
+    }
+    pid_index_entry * old_index = pid_index;
+    int old_mask = pid_index_mask;
+    int old_capacity = process_capacity;
+    process_records = arrays.records;
+#ifdef PROCESS_TABLE_SOA
+    process_pids = arrays.pids;
+    process_statuses = arrays.statuses;
+    process_runtimes = arrays.runtimes;
+#endif
+    pid_index = arrays.pid_index;
+    pid_index_mask = pid_capacity - 1;
+    // Rehash the pid index into its new capacity
+    if (old_capacity > 0) {
+        for (int slot = 0; slot <= old_mask; ++slot) {
+            if (old_index[slot].pid != 0) {
+                pid_index_insert(old_index[slot].pid, old_index[slot].index);
+            }
+        }
+    }
+    // The new slots are UNUSED, push them in reverse so the lowest slot is handed out first
+    for (int i = capacity - 1; i >= old_capacity; --i) {
+        PROCESS_PID(i) = 0;
+        PROCESS_STATUS(i) = UNUSED;
+        PROCESS_RUNTIME(i) = 0;
+        process_records[i].heap_position = -1;
+        process_records[i].cpu = 0;
+        process_records[i].pinned_cpu = -1;
+        process_records[i].pidfd = -1;
+        process_records[i].cgroup_fd = -1;
+        process_records[i].cgroup_freeze_fd = -1;
+        process_records[i].cgroup_stat_fd = -1;
+        process_records[i].output_fd = -1;
+        process_records[i].log_fd = -1;
+        process_records[i].output_ring = -1;
+        process_records[i].job_id = 0;
+        process_records[i].exit_status = EXIT_STATUS_NONE;
+        process_records[i].first_dependent = -1;
+        process_records[i].unfinished_dependencies = 0;
+        process_records[i].path_epoch = 0;
+        process_records[i].ready_since = 0;
+        process_records[i].next_free = unused_head;
+        unused_head = i;
+    }
+    replace_arena(process_arena);
+    process_arena = arena;
+    process_capacity = capacity;
+    return true;
+}
+
+// Map the table of an existing state file, returns false when there is none (A file that cannot be used is fatal)
+bool map_state_file(void) {
+    int fd = open(config.state_file, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        fprintf(stderr, "State file %s is in use by another manager\n", config.state_file);
+        exit(EXIT_FAILURE);
+    }
+    state_header header;
+    struct stat file;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || fstat(fd, &file) == -1) {
+        perror("Reading the state file failed in map_state_file\n");
+        exit(EXIT_FAILURE);
+    }
+    state_header expected;
+    process_arrays arrays;
+    size_t arena_size = layout_process_arena(NULL, header.capacity, header.pid_capacity, &arrays);
+    fill_state_header(&expected, header.capacity, header.pid_capacity, arena_size);
+    if (header.capacity <= 0 || memcmp(&header, &expected, sizeof(header)) != 0 ||
+        (size_t) file.st_size < STATE_HEADER_SIZE + arena_size) {
+        fprintf(stderr, "State file %s was written by an incompatible manager, remove it to start afresh\n", config.state_file);
+        exit(EXIT_FAILURE);
+    }
+    state_map_size = STATE_HEADER_SIZE + arena_size;
+    state_map = mmap(NULL, state_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (state_map == MAP_FAILED) {
+        perror("Mmap failed in map_state_file\n");
+        exit(EXIT_FAILURE);
+    }
+    state_fd = fd;
+    process_arena = state_map + STATE_HEADER_SIZE;
+    layout_process_arena(process_arena, header.capacity, header.pid_capacity, &arrays);
+    process_records = arrays.records;
+#ifdef PROCESS_TABLE_SOA
+    process_pids = arrays.pids;
+    process_statuses = arrays.statuses;
+    process_runtimes = arrays.runtimes;
+#endif
+    pid_index = arrays.pid_index;
+    pid_index_mask = header.pid_capacity - 1;
+    process_capacity = header.capacity;
+    state_recovered = true;
+    return true;
+}
+
+// Remove the state file on a clean exit, the next manager starts with an empty table
+void remove_state_file(void) {
+    if (config.state_file != NULL) {
+        unlink(config.state_file);
+    }
+}
+
+// Initialize process records
+void initialise_process_records(void) {
+    if (config.state_file != NULL && map_state_file()) {
+        // The free-lists and ready queues are rebuilt by recover_processes()
+        return;
+    }
+    int capacity = INITIAL_PROCESSES;
+    if (config.max_processes > 0 && config.max_processes < capacity) {
+        capacity = config.max_processes;
+    }
+    if (!grow_process_table(capacity)) {
+        perror("Allocation failed in initialise_process_records\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Take a slot for a new process record: an UNUSED slot, else the oldest TERMINATED slot, else grow the table
+int allocate_process_slot(void) {
+    if (unused_head < 0 && terminated_head < 0) {
+        // Every slot holds a live process: double the table, up to the configured maximum
+        int capacity = process_capacity * 2;
+        if (config.max_processes > 0 && capacity > config.max_processes) {
+            capacity = config.max_processes;
+        }
+        if (capacity <= process_capacity || !grow_process_table(capacity)) {
+            return -1;
+        }
+    }
+    int index;
+    if (unused_head >= 0) {
+        index = unused_head;
+        unused_head = process_records[index].next_free;
+    } else {
+        index = terminated_head;
+        terminated_head = process_records[index].next_free;
+        if (terminated_head < 0) {
+            terminated_tail = -1;
+        }
+    }
+    process_records[index].next_free = -1;
+    return index;
+}
+
+// Give back a slot taken by allocate_process_slot() that ended up not being used (Its status is unchanged)
+void release_process_slot(int index) {
+    process_record * const p = &process_records[index];
+    if (PROCESS_STATUS(index) == UNUSED) {
+        p->next_free = unused_head;
+        unused_head = index;
+    } else {
+        // Back to the front of the FIFO, it was the oldest TERMINATED slot
+        p->next_free = terminated_head;
+        terminated_head = index;
+        if (terminated_tail < 0) {
+            terminated_tail = index;
+        }
+    }
+}
+
+// Append a slot that just became TERMINATED to the FIFO of replaceable slots
+void push_terminated_slot(int index) {
+    process_records[index].next_free = -1;
+    if (terminated_tail >= 0) {
+        process_records[terminated_tail].next_free = index;
+    } else {
+        terminated_head = index;
+    }
+    terminated_tail = index;
+}
+
+/*
+    DEPENDENCIES (Edges of run --after: a WAITING job is launched once every job it depends on exited successfully)
+*/
+
+// Add an edge to the list of a job: the job of slot dependent (With its job id) waits for it
+void add_dependency(int index, int dependent, pid_t job_id) {
+    if (free_edge < 0) {
+        int capacity = edge_capacity == 0 ? INITIAL_PROCESSES : edge_capacity * 2;
+        dependency_edge * edges = realloc(dependency_edges, capacity * sizeof(dependency_edge));
+        if (edges == NULL) {
+            perror("Realloc failed in add_dependency()\n");
+            exit(EXIT_FAILURE);
+        }
+        // The new edges join the free-list, the lowest first
+        for (int e = capacity - 1; e >= edge_capacity; --e) {
+            edges[e].next = free_edge;
+            free_edge = e;
+        }
+        dependency_edges = edges;
+        edge_capacity = capacity;
+    }
+    int e = free_edge;
+    free_edge = dependency_edges[e].next;
+    dependency_edges[e] = (dependency_edge) {.dependent = dependent, .job_id = job_id,
+                                             .next = process_records[index].first_dependent};
+    process_records[index].first_dependent = e;
+}
+
+// Whether the dependent job of an edge still waits (It did not fail through another dependency, its slot not reused)
+bool dependency_edge_live(const dependency_edge * edge) {
+    return process_records[edge->dependent].job_id == edge->job_id && PROCESS_STATUS(edge->dependent) == WAITING;
+}
+
+// Whether a finished job releases the jobs waiting on it (The exit of an adopted job is not known, it counts as one)
+bool process_succeeded(int index) {
+    const int exit_status = process_records[index].exit_status;
+    return exit_status == 0 || exit_status == EXIT_STATUS_UNKNOWN;
+}
+
+// Release the jobs waiting on a finished job (Defined with the admission, which launches them)
+void release_dependents(int index, bool succeeded);
+
+/*
+    RUNTIME ESTIMATES (Per-program history of observed runtimes in a mapped file, predicting with exponential averaging)
+*/
+
+// FNV-1a hash of a program path, the key of its history entry (Never 0, which marks a free entry)
+uint64_t estimate_key(const char * program) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char * c = program; *c != '\0'; ++c) {
+        hash = (hash ^ (uint8_t) *c) * 0x100000001b3ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Map the history file, creating it (Or starting it afresh when it does not hold a table of this version)
+void setup_estimates(void) {
+    int fd = open(config.estimates_file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("Open failed in setup_estimates()\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t size = sizeof(estimate_header) + ESTIMATE_CAPACITY * sizeof(estimate_entry);
+    estimate_header header;
+    struct stat file;
+    bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) && fstat(fd, &file) == 0 &&
+                 header.magic == ESTIMATE_FILE_MAGIC && header.version == ESTIMATE_FILE_VERSION &&
+                 header.capacity == ESTIMATE_CAPACITY && (size_t) file.st_size >= size;
+    if (!valid && (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1)) {
+        perror("Ftruncate failed in setup_estimates()\n");
+        exit(EXIT_FAILURE);
+    }
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Mmap failed in setup_estimates()\n");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    estimates = map;
+    estimate_entries = (estimate_entry *) (estimates + 1);
+    if (!valid) {
+        // The history is only a hint, an unusable one is dropped (The file was zeroed by the truncation)
+        estimates->magic = ESTIMATE_FILE_MAGIC;
+        estimates->version = ESTIMATE_FILE_VERSION;
+        estimates->capacity = ESTIMATE_CAPACITY;
+    }
+}
+
+// Entry of a program: its own, else a free one, else the least recently used one of its probe window (Taken over)
+int estimate_entry_for(uint64_t key) {
+    int start = (int) (key & (ESTIMATE_CAPACITY - 1));
+    int victim = start;
+    for (int probe = 0; probe < ESTIMATE_PROBES; ++probe) {
+        int slot = (start + probe) & (ESTIMATE_CAPACITY - 1);
+        estimate_entry * const e = &estimate_entries[slot];
+        if (e->key == key) {
+            return slot;
+        }
+        if (e->key == 0) {
+            victim = slot;
+            break;
+        }
+        if (e->last_used < estimate_entries[victim].last_used) {
+            victim = slot;
+        }
+    }
+    estimate_entry * const e = &estimate_entries[victim];
+    e->key = key;
+    e->average = 0;
+    e->samples = 0;
+    return victim;
+}
+
+// Give a newly admitted process the prediction of its program (No prediction before a first run has been seen)
+void predict_runtime(int index, const char * program) {
+    process_record * const p = &process_records[index];
+    p->estimate_slot = -1;
+    p->predicted_runtime = 0;
+    if (estimates == NULL || program == NULL) {
+        return;
+    }
+    p->estimate_key = estimate_key(program);
+    p->estimate_slot = estimate_entry_for(p->estimate_key);
+    estimate_entry * const e = &estimate_entries[p->estimate_slot];
+    e->last_used = ++estimates->clock;
+    if (e->samples > 0) {
+        p->predicted_runtime = e->average;
+    }
+}
+
+// Fold the runtime of a process that exited by itself into the average of its program
+void learn_runtime(int index) {
+    process_record * const p = &process_records[index];
+    if (estimates == NULL || p->estimate_slot < 0) {
+        return;
+    }
+    if (estimate_entries[p->estimate_slot].key != p->estimate_key) {
+        // Its entry went to another program meanwhile, the program gets one again
+        p->estimate_slot = estimate_entry_for(p->estimate_key);
+        estimate_entries[p->estimate_slot].last_used = ++estimates->clock;
+    }
+    estimate_entry * const e = &estimate_entries[p->estimate_slot];
+    if (e->samples == 0) {
+        e->average = p->runtime_used;
+    } else {
+        // average += (sample - average) * 2^-ESTIMATE_SHIFT
+        e->average += (p->runtime_used - e->average) / (1 << ESTIMATE_SHIFT);
+    }
+    if (e->samples < UINT32_MAX) {
+        e->samples++;
+    }
+}
+
+/*
+    SCHEDULING POLICIES (Ready queue keys of READY records and time slices of RUNNING ones)
+*/
+
+// Why a record becomes READY (The policies key these cases differently)
+typedef enum ready_reason {
+    // New, resumed or batch submitted process
+    READY_ENQUEUED = 0,
+    // Running process put back because the scheduler reconsiders its CPU
+    READY_PREEMPTED = 1,
+    // Running process whose time slice ran out
+    READY_EXPIRED = 2
+} ready_reason;
+
+// A scheduling policy: the ready queue key of a record becoming READY, and the slice (ns, 0 for none) of a process
+// starting to run
+typedef struct scheduling_policy {
+    int64_t (*key)(int index, ready_reason reason);
+    int64_t (*slice)(int index);
+    // cpu.weight of the job's cgroup while it runs (cgroup backend)
+    int (*weight)(int index);
+} scheduling_policy;
+
+// The MLFQ key holds the level above an arrival sequence number of this many bits
+#define MLFQ_SEQUENCE_BITS 48
+
+// Arrival order of READY transitions, the round-robin and MLFQ keys
+int64_t ready_sequence = 0;
+// Monotonic time (ns) of the next MLFQ priority boost
+int64_t mlfq_next_boost = 0;
+
+// Runtime a job is expected to need still: the predicted remaining runtime, capped by the budget (A prediction the job
+// already outran is not used)
+int64_t expected_remaining_runtime(int index) {
+    const process_record * const p = &process_records[index];
+    int64_t remaining = PROCESS_RUNTIME(index);
+    if (p->predicted_runtime > p->runtime_used && p->predicted_runtime - p->runtime_used < remaining) {
+        remaining = p->predicted_runtime - p->runtime_used;
+    }
+    return remaining;
+}
+
+// SJF and SRTF: the remaining runtime (It does not change while a record is READY)
+int64_t remaining_runtime_key(int index, ready_reason reason) {
+    (void) reason;
+    const process_record * const p = &process_records[index];
+    int64_t remaining = expected_remaining_runtime(index);
+    // Aging: the effective key remaining - rate * time waited orders the queue like remaining + rate * time enqueued,
+    // which never changes while the record waits (The heap needs no re-keying, older records just sort earlier)
+    if (config.aging_rate > 0) {
+        remaining += (int64_t) (config.aging_rate * (double) p->ready_since);
+    }
+    return remaining;
+}
+
+// Invalidate every memoized critical path (A job gained a dependent, or a WAITING job stopped waiting)
+void invalidate_critical_paths(void) {
+    if (++path_epoch == 0) {
+        path_epoch = 1;
+    }
+}
+
+// Mutually recursive with longest_dependent_path()
+int64_t critical_path(int index);
+
+// Expected runtime of the longest chain of jobs through the jobs waiting on a job, transitively
+int64_t longest_dependent_path(int index) {
+    int64_t longest = 0;
+    for (int e = process_records[index].first_dependent; e >= 0; e = dependency_edges[e].next) {
+        if (dependency_edge_live(&dependency_edges[e])) {
+            int64_t path = critical_path(dependency_edges[e].dependent);
+            if (path > longest) {
+                longest = path;
+            }
+        }
+    }
+    return longest;
+}
+
+// Expected runtime of the longest chain of jobs from a WAITING job (A DAG: edges only lead to jobs submitted later).
+// Memoized until the DAG changes, so shared dependents are visited once: nothing on the path runs while it waits
+int64_t critical_path(int index) {
+    process_record * const p = &process_records[index];
+    if (p->path_epoch == path_epoch) {
+        return p->critical_path;
+    }
+    p->critical_path = expected_remaining_runtime(index) + longest_dependent_path(index);
+    p->path_epoch = path_epoch;
+    return p->critical_path;
+}
+
+// Critical path: the longest path first, the jobs that hold up the most work behind them (The job itself may have run
+// since its last key, only the paths behind it come from the memo)
+int64_t critical_path_key(int index, ready_reason reason) {
+    (void) reason;
+    return -(expected_remaining_runtime(index) + longest_dependent_path(index));
+}
+
+// Round-robin: the back of the queue, unless a preempted process keeps its turn
+int64_t round_robin_key(int index, ready_reason reason) {
+    if (reason == READY_PREEMPTED) {
+        return process_records[index].sched_key;
+    }
+    return ready_sequence++;
+}
+
+// MLFQ: round-robin within a level, a process using its whole slice drops one level
+int64_t mlfq_key(int index, ready_reason reason) {
+    process_record * const p = &process_records[index];
+    if (reason == READY_PREEMPTED) {
+        return p->sched_key;
+    }
+    if (reason == READY_EXPIRED && p->level < config.mlfq_levels - 1) {
+        p->level++;
+    }
+    return ((int64_t) p->level << MLFQ_SEQUENCE_BITS) | ready_sequence++;
+}
+
+int64_t no_slice(int index) {
+    (void) index;
+    return 0;
+}
+
+int64_t quantum_slice(int index) {
+    (void) index;
+    return config.quantum;
+}
+
+// MLFQ: the slice doubles with every level
+int64_t mlfq_slice(int index) {
+    return config.quantum << process_records[index].level;
+}
+
+// The cgroup v2 default weight
+int default_weight(int index) {
+    (void) index;
+    return 100;
+}
+
+// MLFQ: the weight halves with every level, lower levels yield the CPU to the processes they share it with
+int mlfq_weight(int index) {
+    int weight = 100 >> process_records[index].level;
+    return weight > 0 ? weight : 1;
+}
+
+const scheduling_policy policies[] = {
+    [POLICY_SJF] = {remaining_runtime_key, no_slice, default_weight},
+    [POLICY_SRTF] = {remaining_runtime_key, quantum_slice, default_weight},
+    [POLICY_RR] = {round_robin_key, quantum_slice, default_weight},
+    [POLICY_MLFQ] = {mlfq_key, mlfq_slice, mlfq_weight},
+    [POLICY_CRITICAL_PATH] = {critical_path_key, no_slice, default_weight}
+};
+
+// Key a record becoming READY with the configured policy
+void set_ready_key(int index, process_status previous) {
+    process_record * const p = &process_records[index];
+    ready_reason reason = READY_ENQUEUED;
+    if (previous == RUNNING) {
+        reason = p->slice_expired ? READY_EXPIRED : READY_PREEMPTED;
+    }
+    p->slice_expired = false;
+    p->sched_key = policies[config.policy].key(index, reason);
+}
+
+/*
+    READY QUEUE (Indexed min-heap of READY records, ordered by remaining runtime for SJF)
+*/
+
+// Heap order: shorter remaining runtime first, ties broken by the lower slot (Same choice as a scan of the table)
+bool ready_queue_less(int a, int b) {
+    const int64_t key_a = process_records[a].sched_key;
+    const int64_t key_b = process_records[b].sched_key;
+    if (key_a != key_b) {
+        return key_a < key_b;
+    }
+    return a < b;
+}
+
+// Ready queue of the CPU a record is assigned to (The admission queue while it is PENDING)
+ready_queue * ready_queue_of(int index) {
+    if (PROCESS_STATUS(index) == PENDING) {
+        return &admission_queue;
+    }
+    return &cpus[process_records[index].cpu].queue;
+}
+
+// Place a slot at a heap position and remember the position in its record
+void ready_queue_place(ready_queue * queue, int position, int index) {
+    queue->heap[position] = index;
+    process_records[index].heap_position = position;
+}
+
+// Move the slot at a heap position up until its parent is smaller
+void ready_queue_sift_up(ready_queue * queue, int position) {
+    int index = queue->heap[position];
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if (!ready_queue_less(index, queue->heap[parent])) {
+            break;
+        }
+        ready_queue_place(queue, position, queue->heap[parent]);
+        position = parent;
+    }
+    ready_queue_place(queue, position, index);
+}
+
+// Move the slot at a heap position down until both children are larger
+void ready_queue_sift_down(ready_queue * queue, int position) {
+    int index = queue->heap[position];
+    while (true) {
+        int child = 2 * position + 1;
+        if (child >= queue->size) {
+            break;
+        }
+        if (child + 1 < queue->size && ready_queue_less(queue->heap[child + 1], queue->heap[child])) {
+            child++;
+        }
+        if (!ready_queue_less(queue->heap[child], index)) {
+            break;
+        }
+        ready_queue_place(queue, position, queue->heap[child]);
+        position = child;
+    }
+    ready_queue_place(queue, position, index);
+}
+
+// Make room for one more slot in a ready queue
+void ready_queue_reserve(ready_queue * queue) {
+    if (queue->size == queue->capacity) {
+        // Runqueues grow independently, a CPU only pays for the processes queued on it
+        int capacity = queue->capacity == 0 ? INITIAL_PROCESSES : queue->capacity * 2;
+        int * heap = realloc(queue->heap, capacity * sizeof(int));
+        if (heap == NULL) {
+            perror("Realloc failed in ready_queue_reserve\n");
+            exit(EXIT_FAILURE);
+        }
+        queue->heap = heap;
+        queue->capacity = capacity;
+    }
+}
+
+// Insert a slot into the ready queue of its CPU in O(log n)
+void ready_queue_push(int index) {
+    ready_queue * const queue = ready_queue_of(index);
+    ready_queue_reserve(queue);
+    ready_queue_place(queue, queue->size++, index);
+    ready_queue_sift_up(queue, queue->size - 1);
+}
+
+// Append a record to its queue as READY with the key it already has, without restoring the heap order
+void ready_queue_append_keyed(int index) {
+    // A reattached job that was READY already keeps its watch sequence, and gets no journal record (Only status
+    // changes move or record it)
+    if (PROCESS_STATUS(index) != READY) {
+        journal_transition(index, PROCESS_STATUS(index), READY);
+        process_records[index].changed_seq = ++change_sequence;
+    }
+    PROCESS_STATUS(index) = READY;
+    if (config.ready_queue == READY_QUEUE_SCAN) {
+        return;
+    }
+    ready_queue * const queue = ready_queue_of(index);
+    ready_queue_reserve(queue);
+    ready_queue_place(queue, queue->size++, index);
+}
+
+// Mark a record READY by appending it to its queue without restoring the heap order (Bulk insertion, see heapify)
+void ready_queue_append(int index) {
+    // The enqueue time first, the aged key depends on it (As in set_process_status)
+    process_records[index].ready_since = monotonic_ns();
+    set_ready_key(index, PROCESS_STATUS(index));
+    ready_queue_append_keyed(index);
+}
+
+// Restore the heap order of a queue after appends, in O(n) (Bottom-up heap construction)
+void ready_queue_heapify(ready_queue * queue) {
+    for (int position = queue->size / 2 - 1; position >= 0; --position) {
+        ready_queue_sift_down(queue, position);
+    }
+}
+
+// Restore the heap order after the remaining runtime of a queued slot changed (Decrease-key or increase-key)
+void ready_queue_update(int index) {
+    ready_queue * const queue = ready_queue_of(index);
+    int position = process_records[index].heap_position;
+    if (position < 0) {
+        return;
+    }
+    if (position > 0 && ready_queue_less(index, queue->heap[(position - 1) / 2])) {
+        ready_queue_sift_up(queue, position);
+    } else {
+        ready_queue_sift_down(queue, position);
+    }
+}
+
+// Remove a slot from anywhere in the ready queue of its CPU in O(log n)
+void ready_queue_remove(int index) {
+    ready_queue * const queue = ready_queue_of(index);
+    int position = process_records[index].heap_position;
+    if (position < 0) {
+        return;
+    }
+    process_records[index].heap_position = -1;
+    int last = queue->heap[--queue->size];
+    if (last == index) {
+        return;
+    }
+    // Fill the hole with the last slot and restore the heap order in whichever direction it is violated
+    ready_queue_place(queue, position, last);
+    ready_queue_update(last);
+}
+
+// Whether records of a status are kept in a queue (READY ones only in heap mode, PENDING ones always)
+bool status_is_queued(process_status status) {
+    return status == PENDING || (status == READY && config.ready_queue == READY_QUEUE_HEAP);
+}
+
+// Change the status of a record, keeping the ready queue equal to the set of READY records (In heap mode) and the
+// admission queue equal to the set of PENDING records
+void set_process_status(int index, process_status status) {
+    if (PROCESS_STATUS(index) == status) {
+        return;
+    }
+    journal_transition(index, PROCESS_STATUS(index), status);
+    if (status == TERMINATED) {
+        // The slot can be replaced by a new process from now on
+        push_terminated_slot(index);
+    }
+    process_records[index].changed_seq = ++change_sequence;
+    if (status == READY || status == PENDING) {
+        // The enqueue time first, the aged key depends on it
+        process_records[index].ready_since = monotonic_ns();
+        set_ready_key(index, PROCESS_STATUS(index));
+    }
+    if (PROCESS_STATUS(index) == WAITING) {
+        // Its dependencies no longer lead through it
+        invalidate_critical_paths();
+    }
+    // Leave the queue of the old status before the status changes (The status selects the queue), then join the new one
+    if (status_is_queued(PROCESS_STATUS(index))) {
+        ready_queue_remove(index);
+    }
+    PROCESS_STATUS(index) = status;
+    if (status_is_queued(status)) {
+        ready_queue_push(index);
+    }
+}
+
+// Key the queued jobs with dependents again after jobs gained dependents (Their critical paths may have grown, however
+// far up the DAG), restoring the order of the queues whose keys changed
+void rekey_critical_paths(void) {
+    invalidate_critical_paths();
+    for (int queue_number = 0; queue_number <= cpu_count; ++queue_number) {
+        ready_queue * const queue = queue_number < cpu_count ? &cpus[queue_number].queue : &admission_queue;
+        bool changed = false;
+        for (int position = 0; position < queue->size; ++position) {
+            process_record * const p = &process_records[queue->heap[position]];
+            if (p->first_dependent < 0) {
+                continue;
+            }
+            int64_t key = critical_path_key(queue->heap[position], READY_ENQUEUED);
+            if (key != p->sched_key) {
+                p->sched_key = key;
+                changed = true;
+            }
+        }
+        if (changed) {
+            ready_queue_heapify(queue);
+        }
+    }
+}
+
+/*
+    MIN RUNTIME KERNELS (Argmin of remaining runtime over READY slots of SoA arrays: scalar, SSE4.2 and AVX2)
+*/
+
+// All kernels return the first slot with the minimum remaining runtime among READY slots, or -1 if there is none
+
+int min_runtime_scalar(const uint8_t * statuses, const int64_t * runtimes, int count) {
+    int min_index = -1;
+    int64_t min_runtime = INT64_MAX;
+    for (int i = 0; i < count; ++i) {
+        if (statuses[i] == READY && runtimes[i] < min_runtime) {
+            min_runtime = runtimes[i];
+            min_index = i;
+        }
+    }
+    return min_index;
+}
+
+#ifdef HAVE_X86_SIMD
+// Reduce per-lane minimums to the overall minimum (Lowest slot on ties) and finish the unvectorized tail
+int min_runtime_reduce(const int64_t * lane_runtimes, const int64_t * lane_indices, int lanes,
+                       const uint8_t * statuses, const int64_t * runtimes, int start, int count) {
+    int min_index = -1;
+    int64_t min_runtime = INT64_MAX;
+    for (int lane = 0; lane < lanes; ++lane) {
+        if (lane_indices[lane] < 0) {
+            continue;
+        }
+        if (lane_runtimes[lane] < min_runtime || (lane_runtimes[lane] == min_runtime && lane_indices[lane] < min_index)) {
+            min_runtime = lane_runtimes[lane];
+            min_index = (int) lane_indices[lane];
+        }
+    }
+    // Tail slots come after every vectorized slot, so a strict comparison keeps the first minimum
+    for (int i = start; i < count; ++i) {
+        if (statuses[i] == READY && runtimes[i] < min_runtime) {
+            min_runtime = runtimes[i];
+            min_index = i;
+        }
+    }
+    return min_index;
+}
+
+// 64-bit signed comparisons need SSE4.2 (pcmpgtq)
+__attribute__((target("sse4.2")))
+int min_runtime_sse42(const uint8_t * statuses, const int64_t * runtimes, int count) {
+    const __m128i ready = _mm_set1_epi64x(READY);
+    const __m128i step = _mm_set1_epi64x(2);
+    __m128i best = _mm_set1_epi64x(INT64_MAX);
+    __m128i best_index = _mm_set1_epi64x(-1);
+    __m128i index = _mm_set_epi64x(1, 0);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint16_t packed;
+        memcpy(&packed, statuses + i, sizeof(packed));
+        // Widen 2 status bytes to 64-bit lanes, a lane is a candidate if READY and strictly below the lane minimum
+        __m128i status = _mm_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+        __m128i runtime = _mm_loadu_si128((const __m128i *) (runtimes + i));
+        __m128i better = _mm_and_si128(_mm_cmpeq_epi64(status, ready), _mm_cmpgt_epi64(best, runtime));
+        best = _mm_blendv_epi8(best, runtime, better);
+        best_index = _mm_blendv_epi8(best_index, index, better);
+        index = _mm_add_epi64(index, step);
+    }
+    int64_t lane_runtimes[2];
+    int64_t lane_indices[2];
+    _mm_storeu_si128((__m128i *) lane_runtimes, best);
+    _mm_storeu_si128((__m128i *) lane_indices, best_index);
+    return min_runtime_reduce(lane_runtimes, lane_indices, 2, statuses, runtimes, i, count);
+}
+
+__attribute__((target("avx2")))
+int min_runtime_avx2(const uint8_t * statuses, const int64_t * runtimes, int count) {
+    const __m256i ready = _mm256_set1_epi64x(READY);
+    const __m256i step = _mm256_set1_epi64x(4);
+    __m256i best = _mm256_set1_epi64x(INT64_MAX);
+    __m256i best_index = _mm256_set1_epi64x(-1);
+    __m256i index = _mm256_setr_epi64x(0, 1, 2, 3);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int packed;
+        memcpy(&packed, statuses + i, sizeof(packed));
+        // Widen 4 status bytes to 64-bit lanes, a lane is a candidate if READY and strictly below the lane minimum
+        __m256i status = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+        __m256i runtime = _mm256_loadu_si256((const __m256i *) (runtimes + i));
+        __m256i better = _mm256_and_si256(_mm256_cmpeq_epi64(status, ready), _mm256_cmpgt_epi64(best, runtime));
+        best = _mm256_blendv_epi8(best, runtime, better);
+        best_index = _mm256_blendv_epi8(best_index, index, better);
+        index = _mm256_add_epi64(index, step);
+    }
+    int64_t lane_runtimes[4];
+    int64_t lane_indices[4];
+    _mm256_storeu_si256((__m256i *) lane_runtimes, best);
+    _mm256_storeu_si256((__m256i *) lane_indices, best_index);
+    return min_runtime_reduce(lane_runtimes, lane_indices, 4, statuses, runtimes, i, count);
+}
+#endif
+
+// Kernel signature, and the best kernel for this CPU (Picked once by select_min_runtime_kernel())
+typedef int (* min_runtime_kernel)(const uint8_t * statuses, const int64_t * runtimes, int count);
+min_runtime_kernel min_runtime_best = min_runtime_scalar;
+const char * min_runtime_best_name = "scalar";
+
+void select_min_runtime_kernel(void) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        min_runtime_best = min_runtime_avx2;
+        min_runtime_best_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        min_runtime_best = min_runtime_sse42;
+        min_runtime_best_name = "sse4.2";
+    }
+#endif
+}
+
+// Find the index of the process record with minimum remaining runtime (The top of the runqueue of a CPU, or a table scan)
+int find_min_runtime_process(int cpu) {
+    if (config.ready_queue == READY_QUEUE_HEAP) {
+        const ready_queue * const queue = &cpus[cpu].queue;
+        return queue->size > 0 ? queue->heap[0] : -1;
+    }
+#ifdef PROCESS_TABLE_SOA
+    return min_runtime_best(process_statuses, process_runtimes, process_capacity);
+#else
+    // Records interleave the fields, only the scalar scan applies
+    int min_index = -1;
+    int64_t min_runtime = INT64_MAX;
+    for (int i = 0; i < process_capacity; ++i) {
+        if (PROCESS_STATUS(i) == READY && PROCESS_RUNTIME(i) < min_runtime) {
+            min_runtime = PROCESS_RUNTIME(i);
+            min_index = i;
+        }
+    }
+    return min_index;
+#endif
+}
+
+/*
+    PROCESS LAUNCH (fork or posix_spawn, optionally starting the job already stopped)
+*/
+
+// Trampoline run in a job spawned stopped: wait for the scheduler to continue it, then become the command
+void spawn_stopped_trampoline(char * argv[]) {
+    raise(SIGSTOP);
+    execvp(argv[0], argv);
+    // If the exec fails, print an error message and exit the child process
+    perror("Execution failed in spawn_stopped_trampoline()\n");
+    _exit(EXIT_FAILURE);
+}
+
+// Launch with fork(), the child stops itself before exec when asked to
+pid_t launch_fork(char * argv[], bool stopped, int output_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child process: Restore the signal mask first, a blocked SIGCHLD would otherwise be inherited across exec
+        sigprocmask(SIG_SETMASK, &original_signal_mask, NULL);
+        if (output_fd >= 0) {
+            dup2(output_fd, STDOUT_FILENO);
+            dup2(output_fd, STDERR_FILENO);
+        }
+        if (stopped) {
+            raise(SIGSTOP);
+        }
+        // Since './' will be present in the input, we can directly execute the command
+        execvp(argv[0], argv);
+        // If the exec fails, print an error message and exit the child process
+        perror("Execution failed in launch_fork()\n");
+        exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Launch with posix_spawn(), through the trampoline (The manager binary re-executed) when the job must start stopped
+pid_t launch_spawn(char * argv[], bool stopped, int output_fd) {
+    posix_spawnattr_t attributes;
+    if ((errno = posix_spawnattr_init(&attributes)) != 0) {
+        return -1;
+    }
+    // The signal mask is reset in the child like on the fork path
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&attributes, &original_signal_mask);
+    // A captured job writes its stdout and stderr to its pipe (The trampoline passes them on across its exec)
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_t * file_actions = NULL;
+    if (output_fd >= 0) {
+        if ((errno = posix_spawn_file_actions_init(&actions)) != 0) {
+            posix_spawnattr_destroy(&attributes);
+            return -1;
+        }
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDERR_FILENO);
+        file_actions = &actions;
+    }
+    pid_t pid;
+    int result;
+    if (stopped) {
+        // Trampoline argv: the marker argument followed by the command and its arguments
+        int count = 0;
+        while (argv[count] != NULL) {
+            count++;
+        }
+        char ** trampoline = malloc((count + 3) * sizeof(char *));
+        if (trampoline == NULL) {
+            posix_spawnattr_destroy(&attributes);
+            if (file_actions != NULL) {
+                posix_spawn_file_actions_destroy(file_actions);
+            }
+            errno = ENOMEM;
+            return -1;
+        }
+        trampoline[0] = "/proc/self/exe";
+        trampoline[1] = SPAWN_STOPPED_ARGUMENT;
+        memcpy(trampoline + 2, argv, (count + 1) * sizeof(char *));
+        result = posix_spawn(&pid, trampoline[0], file_actions, &attributes, trampoline, environ);
+        free(trampoline);
+    } else {
+        result = posix_spawnp(&pid, argv[0], file_actions, &attributes, argv, environ);
+    }
+    posix_spawnattr_destroy(&attributes);
+    if (file_actions != NULL) {
+        posix_spawn_file_actions_destroy(file_actions);
+    }
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return pid;
+}
+
+// Launch a job with the configured spawn mode, returns its pid or -1 (errno set)
+// With an output_fd (Not -1) it replaces the stdout and stderr of the job, the caller closes it after the launch
+// A job launched stopped has stopped by the time this returns, so a later SIGCONT can never be lost to a race with its
+// own SIGSTOP; it never runs any of its command before the scheduler picks it
+pid_t launch_process(char * argv[], bool stopped, int output_fd) {
+    pid_t pid = config.spawn == SPAWN_POSIX ? launch_spawn(argv, stopped, output_fd) : launch_fork(argv, stopped, output_fd);
+    if (pid > 0 && stopped) {
+        siginfo_t info;
+        // WNOWAIT leaves an early exit to the reaper, the stop notification itself is never reported there
+        while (waitid(P_PID, pid, &info, WSTOPPED | WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+        }
+    }
+    return pid;
+}
+
+// One job of a runbatch: its command line (Tokenized in place), runtime budget, slot and launch result
+typedef struct batch_job {
+    char * line;
+    // Same argument limit as execute_command
+    char * args[10];
+    int64_t runtime;
+    int index;
+    // Ends of the output pipe of the job (-1 without capture)
+    int output_fd;
+    int output_read_end;
+    pid_t pid;
+    int error;
+} batch_job;
+
+// Work shared by the threads of the spawn pool: jobs are claimed one at a time from a shared counter
+typedef struct spawn_pool {
+    batch_job * jobs;
+    int count;
+    atomic_int next;
+} spawn_pool;
+
+// Launch the jobs of a batch, stopped, until none is left (There is no manager state touched here)
+void * spawn_pool_worker(void * argument) {
+    spawn_pool * const pool = argument;
+    int i;
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        batch_job * const job = &pool->jobs[i];
+        job->pid = launch_process(job->args, true, job->output_fd);
+        job->error = job->pid < 0 ? errno : 0;
+    }
+    return NULL;
+}
+
+// Launch every job of a batch with config.spawn_workers threads (Launches overlap their fork/exec and stop waits)
+void launch_batch(batch_job * jobs, int count) {
+    spawn_pool pool = {.jobs = jobs, .count = count};
+    atomic_init(&pool.next, 0);
+    int workers = config.spawn_workers < count ? config.spawn_workers : count;
+    pthread_t threads[workers > 1 ? workers - 1 : 1];
+    int started = 0;
+    for (; started < workers - 1; ++started) {
+        if (pthread_create(&threads[started], NULL, spawn_pool_worker, &pool) != 0) {
+            // Fewer threads only make the batch slower
+            break;
+        }
+    }
+    // The main thread takes part in the launches
+    spawn_pool_worker(&pool);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+    BENCHMARKS (Run with --bench-min-runtime or --bench-launch, not part of normal operation)
+*/
+
+// Hot fields in the interleaved (AoS) record layout, used to time the original scalar loop
+typedef struct bench_record {
+    pid_t pid;
+    process_status status;
+    int64_t remaining_runtime;
+} bench_record;
+
+// The original find_min_runtime_process() loop over interleaved records
+int min_runtime_records(const bench_record * records, int count) {
+    int min_index = -1;
+    int64_t min_runtime = INT64_MAX;
+    for (int i = 0; i < count; ++i) {
+        const bench_record * const p = &records[i];
+        if (p->status == READY) {
+            if (p->remaining_runtime < min_runtime) {
+                min_runtime = p->remaining_runtime;
+                min_index = i;
+            }
+        }
+    }
+    return min_index;
+}
+
+// Time one kernel (Or the record loop when kernel is NULL) over a table, returns nanoseconds per call
+double bench_min_runtime_kernel(min_runtime_kernel kernel, const bench_record * records, const uint8_t * statuses,
+                                const int64_t * runtimes, int count, int expected) {
+    // Repeat the call enough times for roughly 100M slots in total
+    long iterations = 100000000L / count + 1;
+    volatile int sink = 0;
+    double start = (double) monotonic_ns();
+    for (long i = 0; i < iterations; ++i) {
+        int result = kernel != NULL ? kernel(statuses, runtimes, count) : min_runtime_records(records, count);
+        if (result != expected) {
+            fprintf(stderr, "Kernel result %d differs from the expected %d\n", result, expected);
+            exit(EXIT_FAILURE);
+        }
+        sink += result;
+    }
+    (void) sink;
+    return ((double) monotonic_ns() - start) / iterations;
+}
+
+// Compare the original record loop to the SoA kernels at 64, 4K and 1M records (Half of them READY)
+void bench_min_runtime(void) {
+    static const int sizes[] = {64, 4096, 1048576};
+    select_min_runtime_kernel();
+    printf("%10s %14s %14s %14s %14s\n", "records", "records (ns)", "scalar (ns)", "sse4.2 (ns)", "avx2 (ns)");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        int count = sizes[s];
+        bench_record * records = malloc(count * sizeof(bench_record));
+        uint8_t * statuses = aligned_alloc(CACHE_LINE_SIZE, cache_align(count * sizeof(uint8_t)));
+        int64_t * runtimes = aligned_alloc(CACHE_LINE_SIZE, cache_align(count * sizeof(int64_t)));
+        if (records == NULL || statuses == NULL || runtimes == NULL) {
+            perror("Allocation failed in bench_min_runtime\n");
+            exit(EXIT_FAILURE);
+        }
+        srand(205);
+        for (int i = 0; i < count; ++i) {
+            records[i].pid = i + 1;
+            records[i].status = statuses[i] = (rand() % 2 == 0) ? READY : STOPPED;
+            records[i].remaining_runtime = runtimes[i] = (1 + rand() % 100000) * 1000000LL;
+        }
+        int expected = min_runtime_scalar(statuses, runtimes, count);
+        printf("%10d %14.1f %14.1f", count,
+               bench_min_runtime_kernel(NULL, records, statuses, runtimes, count, expected),
+               bench_min_runtime_kernel(min_runtime_scalar, records, statuses, runtimes, count, expected));
+#ifdef HAVE_X86_SIMD
+        if (__builtin_cpu_supports("sse4.2")) {
+            printf(" %14.1f", bench_min_runtime_kernel(min_runtime_sse42, records, statuses, runtimes, count, expected));
+        } else {
+            printf(" %14s", "n/a");
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            printf(" %14.1f", bench_min_runtime_kernel(min_runtime_avx2, records, statuses, runtimes, count, expected));
+        } else {
+            printf(" %14s", "n/a");
+        }
+#else
+        printf(" %14s %14s", "n/a", "n/a");
+#endif
+        printf("\n");
+        free(records);
+        free(statuses);
+        free(runtimes);
+    }
+}
+
+// Launch and reap /bin/true repeatedly with one launch path, returns the mean launch latency in microseconds
+double bench_launch_mode(spawn_mode mode, bool stopped, int launches) {
+    char * argv[] = {"/bin/true", NULL};
+    config.spawn = mode;
+    int64_t total = 0;
+    for (int i = 0; i < launches; ++i) {
+        int64_t start = monotonic_ns();
+        pid_t pid = launch_process(argv, stopped, -1);
+        total += monotonic_ns() - start;
+        if (pid < 0) {
+            perror("Launch failed in bench_launch_mode\n");
+            exit(EXIT_FAILURE);
+        }
+        if (stopped) {
+            kill(pid, SIGCONT);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (double) total / launches / NS_PER_US;
+}
+
+// Compare the fork and posix_spawn launch paths with a small manager and with 256 MiB of touched memory
+void bench_launch(void) {
+    static const size_t ballasts[] = {0, 256 << 20};
+    const int launches = 200;
+    printf("%12s %14s %14s %14s %14s\n", "ballast MiB", "fork (us)", "spawn (us)", "fork stop (us)", "spawn stop (us)");
+    for (size_t b = 0; b < sizeof(ballasts) / sizeof(ballasts[0]); ++b) {
+        // Resident memory the fork path has to copy the page tables of
+        char * ballast = NULL;
+        if (ballasts[b] > 0) {
+            ballast = malloc(ballasts[b]);
+            if (ballast == NULL) {
+                perror("Allocation failed in bench_launch\n");
+                exit(EXIT_FAILURE);
+            }
+            memset(ballast, 1, ballasts[b]);
+        }
+        printf("%12zu %14.1f %14.1f %14.1f %14.1f\n", ballasts[b] >> 20,
+               bench_launch_mode(SPAWN_FORK, false, launches), bench_launch_mode(SPAWN_POSIX, false, launches),
+               bench_launch_mode(SPAWN_FORK, true, launches), bench_launch_mode(SPAWN_POSIX, true, launches));
+        free(ballast);
+    }
+}
+
+/*
+    CPUS (One running process per CPU, per-CPU runqueues balanced by work stealing)
+*/
+
+// Set up the CPUs processes run on: the first config.cpus CPUs the manager itself is allowed to run on
+void setup_cpus(void) {
+    cpu_set_t allowed;
+    int allowed_cpus[CPU_SETSIZE];
+    int allowed_count = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("Sched_getaffinity failed in setup_cpus\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            allowed_cpus[allowed_count++] = cpu;
+        }
+    }
+    // 0 means one running process per allowed CPU
+    cpu_count = config.cpus > 0 ? config.cpus : allowed_count;
+    // A simulation may have more (Virtual) CPUs than the machine
+    if (cpu_count > allowed_count && !simulating) {
+        fprintf(stderr, "Only %d CPUs are available, cannot run %d processes concurrently\n", allowed_count, cpu_count);
+        exit(EXIT_FAILURE);
+    }
+    cpus = calloc(cpu_count, sizeof(cpu_state));
+    if (cpus == NULL) {
+        perror("Calloc failed in setup_cpus\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < cpu_count; ++i) {
+        cpus[i].cpu = i < allowed_count ? allowed_cpus[i] : i;
+        cpus[i].running = -1;
+    }
+}
+
+// Pin a process to the CPU it is assigned to (Only with several CPUs, a single CPU keeps the default affinity)
+void pin_process(int index) {
+    process_record * const p = &process_records[index];
+    int cpu = cpus[p->cpu].cpu;
+    if (cpu_count == 1 || p->pinned_cpu == cpu || simulating) {
+        return;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (sched_setaffinity(PROCESS_PID(index), sizeof(mask), &mask) == -1) {
+        perror("Sched_setaffinity failed in pin_process\n");
+        return;
+    }
+    p->pinned_cpu = cpu;
+}
+
+// Least loaded CPU (Running process plus queued processes), new and resumed processes are queued there
+int pick_cpu(void) {
+    int best = 0;
+    int best_load = INT_MAX;
+    for (int i = 0; i < cpu_count; ++i) {
+        int load = (cpus[i].running >= 0 ? 1 : 0) + cpus[i].queue.size;
+        if (load < best_load) {
+            best_load = load;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Assign a record to a CPU and pin it there (The record must not be queued)
+void assign_process_cpu(int index, int cpu) {
+    process_records[index].cpu = cpu;
+    pin_process(index);
+}
+
+// Take a RUNNING process off its CPU without charging it, returns the CPU (The caller sets the new status)
+int free_cpu(int index) {
+    int cpu = process_records[index].cpu;
+    cpus[cpu].running = -1;
+    cpus[cpu].slice_end = 0;
+    running_count--;
+    return cpu;
+}
+
+// Take a RUNNING process off its CPU, charging it up to now, returns the CPU (The caller sets the new status)
+int release_cpu(int index) {
+    charge_process(index);
+    return free_cpu(index);
+}
+
+// Steal the shortest READY process from the longest runqueue of another CPU (Work stealing for an idle CPU)
+int steal_ready_process(int cpu) {
+    int victim = -1;
+    int longest = 0;
+    for (int i = 0; i < cpu_count; ++i) {
+        if (i != cpu && cpus[i].queue.size > longest) {
+            longest = cpus[i].queue.size;
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return -1;
+    }
+    int index = cpus[victim].queue.heap[0];
+    ready_queue_remove(index);
+    assign_process_cpu(index, cpu);
+    ready_queue_push(index);
+    return index;
+}
+
+/*
+    CHILD REAPING: PIDFDS AND SIGCHLD (To handle child process termination automatically)
+*/
+
+// Open a pidfd for a new child and register it with the event loop, so its exit is delivered as its own event
+void track_process(int index) {
+    process_record * const p = &process_records[index];
+    if (simulating) {
+        // A synthetic process, its pid may belong to a real one
+        return;
+    }
+    p->pidfd = (int) syscall(SYS_pidfd_open, PROCESS_PID(index), 0);
+    if (p->pidfd == -1) {
+        // Without pidfds (Older kernels) the SIGCHLD path reaps the process and signals go through kill()
+        return;
+    }
+    add_event_source(p->pidfd, EVENT_PIDFD, index, EPOLLIN);
+}
+
+// Stop tracking a process (Closing its pidfd also removes it from the epoll instance)
+void untrack_process(int index) {
+    process_record * const p = &process_records[index];
+    if (p->pidfd >= 0) {
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+}
+
+// Send a signal to the process of a record, through its pidfd when it has one (Can never reach a recycled pid)
+int signal_process(int index, int signum) {
+    const process_record * const p = &process_records[index];
+    if (signum == SIGSTOP) {
+        scheduler_stats.stops_sent++;
+    } else if (signum == SIGCONT) {
+        scheduler_stats.continues_sent++;
+    } else if (signum == SIGTERM) {
+        scheduler_stats.terminates_sent++;
+    }
+    if (simulating) {
+        // Counted like a real signal, but nothing is sent
+        return 0;
+    }
+    if (p->pidfd >= 0) {
+        return (int) syscall(SYS_pidfd_send_signal, p->pidfd, signum, NULL, 0);
+    }
+    return kill(PROCESS_PID(index), signum);
+}
+
+// Stop a job from running: freeze its cgroup, or SIGSTOP its process without the cgroup backend
+int suspend_process(int index) {
+    if (process_records[index].cgroup_freeze_fd >= 0 && set_cgroup_frozen(index, true)) {
+        scheduler_stats.freezes++;
+        return 0;
+    }
+    return signal_process(index, SIGSTOP);
+}
+
+// Let a job run again: thaw its cgroup, or SIGCONT its process
+int continue_process(int index) {
+    if (process_records[index].cgroup_freeze_fd >= 0 && set_cgroup_frozen(index, false)) {
+        scheduler_stats.thaws++;
+        return 0;
+    }
+    return signal_process(index, SIGCONT);
+}
+
+// Ask a job to terminate (Processes it forked are killed with its cgroup once the main process exits)
+int terminate_process(int index) {
+    int kill_check = signal_process(index, SIGTERM);
+    // A stopped or frozen process only acts on SIGTERM once continued
+    if (kill_check == 0 && PROCESS_STATUS(index) != RUNNING) {
+        continue_process(index);
+    }
+    return kill_check;
+}
+
+// A job launched stopped for the cgroup backend: join its group, frozen unless it runs now, and leave the launch stop
+void place_launched_process(int index, bool run) {
+    bool in_cgroup = attach_process_cgroup(index);
+    if (in_cgroup && !run) {
+        set_cgroup_frozen(index, true);
+    }
+    // Without a group a job that waits stays in its launch stop
+    if (in_cgroup || run) {
+        signal_process(index, SIGCONT);
+    }
+}
+
+// Update the record of a process that was just reaped, with its exit status (0 when it succeeded)
+void process_exited(int index, const struct rusage * usage, int exit_status) {
+    // If the process was running, update the running process of its CPU
+    if (PROCESS_STATUS(index) == RUNNING) {
+        // Set the running process of the CPU to -1 to trigger the scheduler
+        charge_exited_process(index, usage);
+        free_cpu(index);
+    }
+    process_records[index].exit_status = exit_status;
+    // A process killed by the manager did not run to its end (Its dependents were cancelled by the kill), only the
+    // others refine the estimate of their program and release the jobs waiting on them
+    bool finished = PROCESS_STATUS(index) != TERMINATED;
+    if (finished) {
+        learn_runtime(index);
+    }
+    // Update the status of the process record
+    set_process_status(index, TERMINATED);
+    histogram_record_since(HISTOGRAM_TURNAROUND, process_records[index].admitted_at);
+    if (process_records[index].resident) {
+        process_records[index].resident = false;
+        resident_count--;
+    }
+    untrack_process(index);
+    detach_process_cgroup(index);
+    // In the same event: the jobs released now can take the CPU this one just gave up
+    if (finished) {
+        release_dependents(index, process_succeeded(index));
+    }
+}
+
+// Reap the process of a slot whose pidfd became readable (No table walk, the event names the slot)
+void reap_process(int index) {
+    const process_record * const p = &process_records[index];
+    if (p->pidfd < 0) {
+        // Stale event of a slot reaped earlier in the same batch
+        return;
+    }
+    if (p->adopted) {
+        // Not our child (The manager was restarted): a readable pidfd means it exited, init reaps it
+        process_exited(index, NULL, EXIT_STATUS_UNKNOWN);
+        return;
+    }
+    siginfo_t info;
+    struct rusage usage;
+    memset(&info, 0, sizeof(info));
+    // Raw waitid: unlike the libc wrapper it also reports the resource usage, for cpu accounting
+    if (syscall(SYS_waitid, P_PIDFD, p->pidfd, &info, WEXITED | WNOHANG, &usage) == -1 || info.si_pid == 0) {
+        // Not exited (The slot was reused by a new process since the event was queued)
+        return;
+    }
+    // Same encoding as the shell: the exit code, or 128 + the signal that killed the process
+    process_exited(index, &usage, info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status);
+}
+
+// Reap all remaining terminated children, called from the main loop whenever the signalfd reports SIGCHLD
+// Processes with a pidfd are normally reaped through it just before; this path catches the user interface, processes
+// without a pidfd and processes whose slot was reused before they exited. One call drains every exit with
+// wait4(WNOHANG), however many SIGCHLD were coalesced, and the CPUs it frees are rescheduled once afterwards by the
+// main loop. Reaping only happens here, in the same context as the commands, so a managed pid stays a zombie (Never
+// recycled) until its record is updated, and no signal handler touches the table.
+int reap_children(void) {
+    int reaped = 0;
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    // Reap all terminated child processes (wait4 also reports the CPU time used, for cpu accounting)
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        // Find the process record with the given pid (The user interface child has none)
+        int i = pid_index_lookup(pid);
+        if (i < 0) {
+            continue;
+        }
+        process_exited(i, &usage, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+        reaped++;
+    }
+    return reaped;
+}
+
+// Block SIGCHLD and create a signalfd for it, so that child terminations are delivered as events in the main loop
+void setup_signal_fd(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    // The signal must be blocked, otherwise it would still be delivered the default way instead of through the signalfd
+    if (sigprocmask(SIG_BLOCK, &mask, &original_signal_mask) == -1) {
+        perror("Sigprocmask failed in setup_signal_fd\n");
+        exit(EXIT_FAILURE);
+    }
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        perror("Signalfd failed in setup_signal_fd\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Read all pending SIGCHLD notifications from the signalfd (Several exits may be coalesced into one notification)
+void drain_signal_fd(void) {
+    struct signalfd_siginfo info[16];
+    while (read(signal_fd, info, sizeof(info)) > 0) {
+        // Nothing to do with the contents, wait4() in reap_children() finds every terminated child
+    }
+}
+
+/*
+    SCHEDULER (Placed here to avoid implicit declaration)
+*/
+
+// Give the process just started on a CPU the time slice of the policy
+void start_slice(int cpu) {
+    cpu_state * const c = &cpus[cpu];
+    int64_t slice = policies[config.policy].slice(c->running);
+    c->slice_end = slice > 0 ? monotonic_ns() + slice : 0;
+    set_cgroup_weight(c->running, policies[config.policy].weight(c->running));
+}
+
+// MLFQ anti-starvation: move every process back to level 0, keeping their order within the levels
+void mlfq_boost(void) {
+    const int64_t sequence_mask = ((int64_t) 1 << MLFQ_SEQUENCE_BITS) - 1;
+    for (int i = 0; i < process_capacity; ++i) {
+        process_records[i].level = 0;
+        process_records[i].sched_key &= sequence_mask;
+    }
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        ready_queue_heapify(&cpus[cpu].queue);
+    }
+    ready_queue_heapify(&admission_queue);
+}
+
+// Whether the running process of a CPU keeps it against the best READY candidate (-1 for none), both keyed as READY:
+// compared like the ready queue orders them, or like the table scan picks (The first slot of the smallest runtime)
+bool keeps_cpu(int running, int candidate) {
+    if (candidate < 0) {
+        return true;
+    }
+    if (config.ready_queue == READY_QUEUE_SCAN) {
+        return PROCESS_RUNTIME(running) < PROCESS_RUNTIME(candidate) ||
+               (PROCESS_RUNTIME(running) == PROCESS_RUNTIME(candidate) && running < candidate);
+    }
+    return ready_queue_less(running, candidate);
+}
+
+// Scheduler function to start the process with the minimum remaining runtime (SJF) on one CPU
+void schedule_cpu(int cpu) {
+    cpu_state * const c = &cpus[cpu];
+    scheduler_stats.reschedules++;
+    int64_t start = monotonic_ns();
+    // Find the process with the minimum key (The policy decides what the key is, SJF by default)
+    int64_t pick_start = monotonic_ns();
+    int min_index = find_min_runtime_process(cpu);
+    // Decide first: the running process competes with the key it would get as READY, and only leaves RUNNING (With
+    // the status change, watch sequence, journal record and signals that go with it) if it actually loses the CPU
+    int previous = c->running;
+    if (previous >= 0) {
+        process_record * const p = &process_records[previous];
+        // Charge it up to now, its remaining runtime is its key under SJF and SRTF
+        charge_process(previous);
+        // The policy state keying it changes, put back if it loses (set_process_status keys it again then)
+        const int64_t previous_key = p->sched_key;
+        const int previous_level = p->level;
+        const int64_t previous_sequence = ready_sequence;
+        const bool previous_expired = p->slice_expired;
+        p->ready_since = monotonic_ns();
+        set_ready_key(previous, RUNNING);
+        if (keeps_cpu(previous, min_index)) {
+            // Same decision: no SIGSTOP/SIGCONT pair, and the slice goes on unless it is the one that ran out
+            histogram_record_since(HISTOGRAM_PICK, pick_start);
+            scheduler_stats.signals_avoided += 2;
+            if (previous_expired) {
+                start_slice(cpu);
+            }
+            histogram_record_since(HISTOGRAM_SCHEDULE, start);
+            return;
+        }
+        p->sched_key = previous_key;
+        p->level = previous_level;
+        ready_sequence = previous_sequence;
+        p->slice_expired = previous_expired;
+        release_cpu(previous);
+        set_process_status(previous, READY);
+    } else if (min_index < 0 && config.ready_queue == READY_QUEUE_HEAP) {
+        // Nothing queued on this idle CPU, take work from the busiest one
+        min_index = steal_ready_process(cpu);
+    }
+    int64_t picked = histogram_record_since(HISTOGRAM_PICK, pick_start);
+    // If there is no process to start (No READY processes), return
+    if (min_index < 0) {
+        histogram_record_since(HISTOGRAM_SCHEDULE, start);
+        return;
+    }
+    // Start the process with the minimum key (A scanned process may come from another CPU)
+    set_process_status(min_index, RUNNING);
+    assign_process_cpu(min_index, cpu);
+    c->running = min_index;
+    running_count++;
+    start_charging(min_index);
+    histogram_record(HISTOGRAM_WAIT, picked - process_records[min_index].ready_since);
+    start_slice(cpu);
+    // An actual preemption: stop the previous process, then continue the new one
+    if (previous >= 0) {
+        int kill_check = suspend_process(previous);
+        // If the kill fails, print an error message
+        if (kill_check == -1) {
+            perror("First Kill failed in scheduler()\n");
+        }
+    }
+    int kill_check = continue_process(min_index);
+    // If the kill fails, print an error message
+    if (kill_check == -1) {
+        perror("Second Kill failed in scheduler()\n");
+    }
+    histogram_record_since(HISTOGRAM_SCHEDULE, start);
+}
+
+// Reschedule every CPU
+void scheduler(void) {
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        schedule_cpu(cpu);
+    }
+}
+
+// Reschedule every CPU whose time slice has ended (Called when the quantum timer fires)
+void expire_slices(void) {
+    uint64_t expirations;
+    // Consume the expiration count, otherwise the timerfd stays readable
+    while (read(quantum_fd, &expirations, sizeof(expirations)) > 0) {
+    }
+    quantum_armed_for = 0;
+    int64_t now = monotonic_ns();
+    if (config.policy == POLICY_MLFQ && now >= mlfq_next_boost) {
+        mlfq_boost();
+        mlfq_next_boost = now + config.mlfq_boost;
+    }
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        cpu_state * const c = &cpus[cpu];
+        if (c->running >= 0 && c->slice_end > 0 && c->slice_end <= now) {
+            process_records[c->running].slice_expired = true;
+            schedule_cpu(cpu);
+        }
+    }
+}
+
+/*
+    RECOVERY (Reattaching the live jobs of a state file after a restart of the manager)
+*/
+
+// Start time of a process in clock ticks after boot (Field 22 of /proc/<pid>/stat), -1 if it does not exist
+int64_t process_start_time(pid_t pid) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    char buffer[1024];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+    // The command name may contain spaces, the fields are counted from the state (Field 3) after its last ')'
+    char * field = strrchr(buffer, ')');
+    if (field == NULL) {
+        return -1;
+    }
+    field += 2;
+    for (int i = 3; i < 22; ++i) {
+        field = strchr(field, ' ');
+        if (field == NULL) {
+            return -1;
+        }
+        field++;
+    }
+    return strtoll(field, NULL, 10);
+}
+
+// Reopen the job of a recovered record: a pidfd for the same process (Same start time), and its cgroup
+bool reattach_process(int index) {
+    process_record * const p = &process_records[index];
+    p->pidfd = (int) syscall(SYS_pidfd_open, PROCESS_PID(index), 0);
+    if (p->pidfd == -1) {
+        return false;
+    }
+    // Checked after opening the pidfd, so the pidfd cannot refer to a process that recycled the pid after the check
+    if (process_start_time(PROCESS_PID(index)) != p->start_time) {
+        close(p->pidfd);
+        p->pidfd = -1;
+        return false;
+    }
+    add_event_source(p->pidfd, EVENT_PIDFD, index, EPOLLIN);
+    p->adopted = true;
+    p->resident = true;
+    resident_count++;
+    if (cgroup_root_fd >= 0) {
+        char name[32];
+        cgroup_name(index, name, sizeof(name));
+        p->cgroup_fd = openat(cgroup_root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (p->cgroup_fd >= 0) {
+            p->cgroup_freeze_fd = openat(p->cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC);
+            p->cgroup_stat_fd = openat(p->cgroup_fd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+        }
+    }
+    setup_accounting(index);
+    return true;
+}
+
+// Rebuild the manager state around a recovered table: free-lists, pidfds, ready queues, then schedule once
+// Jobs that were RUNNING or READY are stopped and queued again, STOPPED jobs stay stopped, gone jobs are TERMINATED
+void recover_processes(void) {
+    const int64_t sequence_mask = ((int64_t) 1 << MLFQ_SEQUENCE_BITS) - 1;
+    int reattached = 0;
+    int64_t last_sequence = -1;
+    for (int i = process_capacity - 1; i >= 0; --i) {
+        process_record * const p = &process_records[i];
+        // Descriptors and queue positions belonged to the previous manager
+        p->heap_position = -1;
+        p->next_free = -1;
+        p->pidfd = p->cgroup_fd = p->cgroup_freeze_fd = p->cgroup_stat_fd = -1;
+        p->cgroup_weight = -1;
+        p->output_fd = p->log_fd = p->output_ring = -1;
+        p->slice_expired = false;
+        p->resident = false;
+        p->first_dependent = -1;
+        p->unfinished_dependencies = 0;
+        p->path_epoch = 0;
+        p->pinned_cpu = -1;
+        p->cpu = 0;
+        if (p->job_id >= next_job_id) {
+            next_job_id = p->job_id == INT_MAX ? JOB_ID_BASE : p->job_id + 1;
+        }
+        if (p->changed_seq > change_sequence) {
+            // Watch deltas go on from where the previous manager was
+            change_sequence = p->changed_seq;
+        }
+        if (PROCESS_STATUS(i) != UNUSED && capture_dir_fd >= 0) {
+            // The log file stays readable, the pipe (And a ring) went with the previous manager
+            char name[32];
+            log_file_name(PROCESS_PID(i), name, sizeof(name));
+            p->log_fd = openat(capture_dir_fd, name, O_RDONLY | O_CLOEXEC);
+        }
+        if (PROCESS_STATUS(i) == UNUSED) {
+            // Pushed in reverse so the lowest slot is handed out first
+            p->next_free = unused_head;
+            unused_head = i;
+        } else if (PROCESS_STATUS(i) == PENDING || PROCESS_STATUS(i) == WAITING) {
+            // Its command line (And its dependencies) were on the heap of the previous manager
+            journal_transition(i, PROCESS_STATUS(i), TERMINATED);
+            PROCESS_STATUS(i) = TERMINATED;
+        } else if (PROCESS_STATUS(i) != TERMINATED && !reattach_process(i)) {
+            journal_transition(i, PROCESS_STATUS(i), TERMINATED);
+            PROCESS_STATUS(i) = TERMINATED;
+        }
+    }
+    for (int i = 0; i < process_capacity; ++i) {
+        process_status status = PROCESS_STATUS(i);
+        if (status == UNUSED) {
+            continue;
+        }
+        if (status == TERMINATED) {
+            push_terminated_slot(i);
+            continue;
+        }
+        reattached++;
+        if ((process_records[i].sched_key & sequence_mask) > last_sequence) {
+            last_sequence = process_records[i].sched_key & sequence_mask;
+        }
+        // Only the scheduler decides what runs: every job is stopped, the READY and RUNNING ones queued with their keys
+        suspend_process(i);
+        if (status != STOPPED) {
+            assign_process_cpu(i, pick_cpu());
+            ready_queue_append_keyed(i);
+        }
+    }
+    if (config.policy == POLICY_RR || config.policy == POLICY_MLFQ) {
+        ready_sequence = last_sequence + 1;
+    }
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        ready_queue_heapify(&cpus[cpu].queue);
+    }
+    printf("Reattached %d processes from %s\n", reattached, config.state_file);
+    scheduler();
+}
+
+/*
+    REPLIES (Output of the commands: to the console for the user interface, into a response for socket clients)
+*/
+
+void vreply(FILE * console, bool failure, const char * format, va_list args) {
+    if (current_client < 0) {
+        vfprintf(console, format, args);
+        return;
+    }
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    output_reserve(&reply_output, length + 1);
+    vsnprintf(reply_output.data + reply_output.length, length + 1, format, args);
+    reply_output.length += length;
+    if (failure) {
+        reply_status = RESPONSE_ERROR;
+    }
+}
+
+// Normal output of a command
+void reply(const char * format, ...) __attribute__((format(printf, 1, 2)));
+void reply(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vreply(stdout, false, format, args);
+    va_end(args);
+}
+
+// A command that could not be carried out, reported on the console output
+void reply_failure(const char * format, ...) __attribute__((format(printf, 1, 2)));
+void reply_failure(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vreply(stdout, true, format, args);
+    va_end(args);
+}
+
+// An invalid command, reported on the console error output
+void reply_error(const char * format, ...) __attribute__((format(printf, 1, 2)));
+void reply_error(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vreply(stderr, true, format, args);
+    va_end(args);
+}
+
+// Raw bytes of a command's output (Binary snapshots)
+void reply_bytes(const void * data, size_t length) {
+    if (current_client < 0) {
+        fflush(stdout);
+        if (!write_all(STDOUT_FILENO, data, length)) {
+            perror("Write failed in reply_bytes\n");
+        }
+        return;
+    }
+    output_reserve(&reply_output, length);
+    memcpy(reply_output.data + reply_output.length, data, length);
+    reply_output.length += length;
+}
+
+// Value of the response header (Pid of a new process)
+void reply_with_value(int64_t value) {
+    reply_value = value;
+}
+
+/*
+    SNAPSHOTS (Machine-readable list and watch output: JSON lines or binary, built in one buffer and written at once)
+*/
+
+// Output formats of list and watch
+typedef enum snapshot_format {
+    SNAPSHOT_TEXT = 0,
+    SNAPSHOT_JSON = 1,
+    SNAPSHOT_BINARY = 2
+} snapshot_format;
+
+// Format named by the argument of list or watch (NULL is the text format), returns false for an unknown one
+bool parse_snapshot_format(const char * name, snapshot_format * format) {
+    if (name == NULL) {
+        *format = SNAPSHOT_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = SNAPSHOT_JSON;
+    } else if (strcmp(name, "bin") == 0) {
+        *format = SNAPSHOT_BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Write the records changed after a sequence number (0 for every record) to a file descriptor in one writev (Or into
+// the response of the current client)
+void write_snapshot(int fd, snapshot_format format, uint64_t since) {
+    output_buffer * const output = &snapshot_output;
+    output->length = 0;
+    uint32_t count = 0;
+    // Runtimes of the running processes are current as of now, not of the last accounting tick
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (cpus[cpu].running >= 0) {
+            charge_process(cpus[cpu].running);
+        }
+    }
+    for (int i = 0; i < process_capacity; ++i) {
+        const process_record * const p = &process_records[i];
+        if (PROCESS_STATUS(i) == UNUSED || p->changed_seq <= since) {
+            continue;
+        }
+        count++;
+        if (format == SNAPSHOT_BINARY) {
+            output_reserve(output, sizeof(snapshot_entry));
+            snapshot_entry * const entry = (snapshot_entry *) (output->data + output->length);
+            memset(entry, 0, sizeof(*entry));
+            entry->remaining_ns = PROCESS_RUNTIME(i);
+            entry->used_ns = p->runtime_used;
+            entry->changed_seq = p->changed_seq;
+            entry->pid = PROCESS_PID(i);
+            entry->cpu = p->cpu;
+            entry->status = PROCESS_STATUS(i);
+            output->length += sizeof(snapshot_entry);
+        } else if (format == SNAPSHOT_JSON) {
+            output_printf(output, "{\"pid\":%d,\"status\":\"%s\",\"remaining_ns\":%lld,\"used_ns\":%lld,\"predicted_ns\":%lld,\"cpu\":%d,\"seq\":%llu,"
+                          "\"exit_status\":%d}\n",
+                          (int) PROCESS_PID(i), process_status_names[PROCESS_STATUS(i)],
+                          (long long) PROCESS_RUNTIME(i), (long long) p->runtime_used, (long long) p->predicted_runtime,
+                          p->cpu, (unsigned long long) p->changed_seq, p->exit_status);
+        } else {
+            output_printf(output, "%d, %d\n", (int) PROCESS_PID(i), PROCESS_STATUS(i));
+        }
+    }
+    snapshot_header header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .entry_size = sizeof(snapshot_entry),
+        .count = count,
+        .sequence = change_sequence
+    };
+    if (current_client >= 0) {
+        // Becomes the payload of the client's response
+        if (format == SNAPSHOT_BINARY) {
+            reply_bytes(&header, sizeof(header));
+        }
+        reply_bytes(output->data, output->length);
+        return;
+    }
+    struct iovec iov[2];
+    int iov_count = 0;
+    if (format == SNAPSHOT_BINARY) {
+        iov[iov_count++] = (struct iovec) {.iov_base = &header, .iov_len = sizeof(header)};
+    }
+    if (output->length > 0) {
+        iov[iov_count++] = (struct iovec) {.iov_base = output->data, .iov_len = output->length};
+    }
+    // Anything printed before goes out first
+    fflush(stdout);
+    if (!writev_all(fd, iov, iov_count)) {
+        perror("Writev failed in write_snapshot\n");
+    }
+}
+
+/*
+    ADMISSION (Jobs enter the table launched, or PENDING in the admission queue until the limits of admission control
+    allow a launch: resident jobs, their memory, and how many launched jobs wait to run)
+*/
+
+// Reset a slot for a newly submitted job (Launched or not)
+void prepare_process_slot(int index, int64_t runtime, const char * program) {
+    process_record * const p = &process_records[index];
+    // A reused TERMINATED slot gives up its old pid and job id (And its pidfd if it was killed but has not exited yet)
+    if (PROCESS_STATUS(index) == TERMINATED) {
+        pid_index_remove(PROCESS_PID(index), index);
+        if (p->job_id != 0) {
+            pid_index_remove(p->job_id, index);
+        }
+        untrack_process(index);
+        detach_process_cgroup(index);
+        release_output(index);
+        if (p->resident) {
+            // Forgotten, its exit is not seen any more
+            p->resident = false;
+            resident_count--;
+        }
+    }
+    p->job_id = 0;
+    p->exit_status = EXIT_STATUS_NONE;
+    p->first_dependent = -1;
+    p->unfinished_dependencies = 0;
+    p->path_epoch = 0;
+    PROCESS_RUNTIME(index) = runtime;
+    p->level = 0;
+    p->adopted = false;
+    p->runtime_used = 0;
+    p->admitted_at = monotonic_ns();
+    p->ready_since = p->admitted_at;
+    predict_runtime(index, program);
+}
+
+// Give the slot of a job its newly launched process
+void attach_launched_process(int index, pid_t pid) {
+    process_record * const p = &process_records[index];
+	PROCESS_PID(index) = pid;
+    pid_index_insert(pid, index);
+    track_process(index);
+    setup_accounting(index);
+    p->resident = true;
+    resident_count++;
+    if (config.state_file != NULL) {
+        p->start_time = process_start_time(pid);
+    }
+}
+
+// Store a newly launched process in its slot (Before it is queued on a CPU)
+void admit_process(int index, pid_t pid, int64_t runtime, const char * program) {
+    prepare_process_slot(index, runtime, program);
+    attach_launched_process(index, pid);
+}
+
+// Queue an admitted process on a CPU and reschedule it, the process runs right away when start is set (Idle CPU)
+void queue_admitted_process(int index, int cpu, bool start) {
+    assign_process_cpu(index, cpu);
+	set_process_status(index, READY);
+    // Start the process if there is no running process on that CPU (Otherwise it is already stopped and stays READY)
+    if (start) {
+        histogram_record(HISTOGRAM_WAIT, 0);
+        set_process_status(index, RUNNING);
+        start_charging(index);
+        cpus[cpu].running = index;
+        running_count++;
+        start_slice(cpu);
+    }
+    // We call the scheduler to start the process with the minimum remaining runtime (SJF), unless the process just
+    // started on an idle CPU has nothing READY to compete with (The scheduler would only pick it again)
+    if (!start || find_min_runtime_process(cpu) >= 0) {
+        schedule_cpu(cpu);
+    }
+}
+
+// Whether admission control is configured (Without it every job is launched when it is submitted)
+bool admission_limited(void) {
+    return config.max_resident > 0 || config.max_rss > 0 || config.prefetch >= 0;
+}
+
+// Memory (Bytes) used by the resident jobs: memory.current of the delegated cgroup with the cgroup backend, else the
+// sum of their resident set sizes from /proc/PID/statm
+int64_t resident_memory(void) {
+    char buffer[64];
+    if (cgroup_root_fd >= 0) {
+        int fd = openat(cgroup_root_fd, "memory.current", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+            close(fd);
+            if (length > 0) {
+                buffer[length] = '\0';
+                return strtoll(buffer, NULL, 10);
+            }
+        }
+        // No memory controller for the group, the processes are summed up
+    }
+    static long page_size = 0;
+    if (page_size == 0) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    int64_t total = 0;
+    for (int i = 0; i < process_capacity; ++i) {
+        if (!process_records[i].resident) {
+            continue;
+        }
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int) PROCESS_PID(i));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (length <= 0) {
+            continue;
+        }
+        buffer[length] = '\0';
+        // Second field: resident pages
+        long long resident_pages = 0;
+        if (sscanf(buffer, "%*s %lld", &resident_pages) == 1) {
+            total += resident_pages * page_size;
+        }
+    }
+    return total;
+}
+
+// Whether the head of the admission queue may be launched now, given the memory sample of the admission pass (Taken
+// into *memory on first use when it is negative, so a pass reads /proc once however many jobs it launches)
+bool admission_open(int64_t * memory) {
+    if (config.max_resident > 0 && resident_count >= config.max_resident) {
+        return false;
+    }
+    if (config.prefetch >= 0) {
+        // Lazy launch: a job is launched when a CPU would otherwise idle, or into the window of launched jobs waiting
+        int idle = cpu_count - running_count;
+        if (resident_count - running_count >= config.prefetch + idle) {
+            return false;
+        }
+    }
+    if (config.max_rss == 0) {
+        return true;
+    }
+    // The jobs launched earlier in the pass have not grown yet
+    if (*memory < 0) {
+        *memory = resident_memory();
+    }
+    return *memory < config.max_rss;
+}
+
+// Copy of a command line in a single allocation (The array of pointers followed by the strings)
+char ** copy_arguments(char * argv[]) {
+    size_t count = 0;
+    size_t text_size = 0;
+    while (argv[count] != NULL) {
+        text_size += strlen(argv[count]) + 1;
+        count++;
+    }
+    char ** copy = malloc((count + 1) * sizeof(char *) + text_size);
+    if (copy == NULL) {
+        perror("Malloc failed in copy_arguments()\n");
+        exit(EXIT_FAILURE);
+    }
+    char * text = (char *) (copy + count + 1);
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = strlen(argv[i]) + 1;
+        memcpy(text, argv[i], length);
+        copy[i] = text;
+        text += length;
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+// Give up the command line of a slot that is no longer PENDING or WAITING
+void release_pending_command(int index) {
+    if (index < pending_capacity) {
+        free(pending_commands[index]);
+        pending_commands[index] = NULL;
+    }
+}
+
+// Keep a submitted job without launching it, PENDING in the admission queue or WAITING for its dependencies, under a
+// new job id (Returns the job id)
+pid_t hold_process(int index, char * argv[], int64_t runtime, process_status status) {
+    if (index >= pending_capacity) {
+        int capacity = pending_capacity == 0 ? INITIAL_PROCESSES : pending_capacity;
+        while (capacity <= index) {
+            capacity *= 2;
+        }
+        char ** * commands = realloc(pending_commands, capacity * sizeof(char **));
+        if (commands == NULL) {
+            perror("Realloc failed in hold_process()\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(commands + pending_capacity, 0, (capacity - pending_capacity) * sizeof(char **));
+        pending_commands = commands;
+        pending_capacity = capacity;
+    }
+    prepare_process_slot(index, runtime, argv[0]);
+    pending_commands[index] = copy_arguments(argv);
+    pid_t job_id = next_job_id;
+    next_job_id = next_job_id == INT_MAX ? JOB_ID_BASE : next_job_id + 1;
+    // Until it is launched the job has no process, its job id stands in for the pid
+    PROCESS_PID(index) = job_id;
+    process_records[index].job_id = job_id;
+    pid_index_insert(job_id, index);
+    set_process_status(index, status);
+    return job_id;
+}
+
+// Launch the PENDING job of a slot and queue it on a CPU like a job that was just submitted
+void launch_pending_process(int index) {
+    char ** const argv = pending_commands[index];
+    int cpu = pick_cpu();
+    bool stopped = cpus[cpu].running >= 0;
+    int output_read_end;
+    int output_fd = open_output_pipe(&output_read_end);
+	pid_t pid = launch_process(argv, stopped || cgroup_root_fd >= 0, output_fd);
+    if (output_fd >= 0) {
+        close(output_fd);
+    }
+    if (pid < 0) {
+        fprintf(stderr, "Launch failed for job %d: %s\n", (int) process_records[index].job_id, strerror(errno));
+        if (output_read_end >= 0) {
+            close(output_read_end);
+        }
+        release_pending_command(index);
+        set_process_status(index, TERMINATED);
+        release_dependents(index, false);
+        return;
+    }
+    release_pending_command(index);
+    // The job id stays in the pid index next to the pid, both name the job
+    attach_launched_process(index, pid);
+    attach_output(index, output_read_end);
+    if (cgroup_root_fd >= 0) {
+        place_launched_process(index, !stopped);
+    }
+    queue_admitted_process(index, cpu, !stopped);
+}
+
+// End a job that never ran because a job it depends on failed (Its dependents fail with it)
+void cancel_waiting_process(int index) {
+    fprintf(stderr, "Job %d cancelled, a job it depends on failed\n", (int) process_records[index].job_id);
+    release_pending_command(index);
+    set_process_status(index, TERMINATED);
+    release_dependents(index, false);
+}
+
+// Release the jobs waiting on a job that finished: a WAITING job with nothing left to wait for is launched right away
+// (PENDING under admission control), one waiting on a job that failed is cancelled
+void release_dependents(int index, bool succeeded) {
+    int e = process_records[index].first_dependent;
+    // Every edge is visited once, when the job it belongs to finishes
+    process_records[index].first_dependent = -1;
+    while (e >= 0) {
+        const dependency_edge edge = dependency_edges[e];
+        dependency_edges[e].next = free_edge;
+        free_edge = e;
+        e = edge.next;
+        if (!dependency_edge_live(&edge)) {
+            continue;
+        }
+        if (!succeeded) {
+            cancel_waiting_process(edge.dependent);
+        } else if (--process_records[edge.dependent].unfinished_dependencies == 0) {
+            if (admission_limited()) {
+                set_process_status(edge.dependent, PENDING);
+            } else {
+                launch_pending_process(edge.dependent);
+            }
+        }
+    }
+}
+
+// Launch PENDING jobs in the order of the admission queue for as long as the limits allow it
+void admit_pending_processes(void) {
+    int64_t memory = -1;
+    while (admission_queue.size > 0 && admission_open(&memory)) {
+        launch_pending_process(admission_queue.heap[0]);
+    }
+}
+
+/*
+    CORE FUNCTIONS: RUN, LIST, STOP, RESUME, TERMINATE and EXIT
+*/
+
+// Jobs a run --after waits for: a comma-separated list of pids or job ids, stored as slots (Returns the number of
+// them still unfinished, -1 after an error reply; finished successful ones are left out)
+int parse_dependencies(char * list, int * slots, int slots_max) {
+    int count = 0;
+    for (char * item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        char * end;
+        long id = strtol(item, &end, 10);
+        int index = *end == '\0' && id > 0 && id <= INT_MAX ? pid_index_lookup((pid_t) id) : -1;
+        if (index < 0) {
+            reply_failure("Process %s not found.\n", item);
+            return -1;
+        }
+        if (PROCESS_STATUS(index) == TERMINATED) {
+            if (!process_succeeded(index)) {
+                reply_failure("Process %ld did not exit successfully.\n", id);
+                return -1;
+            }
+            continue;
+        }
+        if (count == slots_max) {
+            reply_failure("Too many dependencies, at most %d.\n", slots_max);
+            return -1;
+        }
+        slots[count++] = index;
+    }
+    return count;
+}
+
+void perform_run(char* args[]) {
+    int64_t start = monotonic_ns();
+    // Ensure that the arguments are valid
+    if (args == NULL) {
+        reply_error("Invalid arguments for perform_run()\n");
+        return;
+    }
+    // run --after ID[,ID...] waits for those jobs to exit successfully before launching
+    int dependencies[64];
+    int dependency_count = 0;
+    if (args[1] != NULL && strcmp(args[1], "--after") == 0) {
+        if (args[2] == NULL) {
+            reply_error("Invalid arguments for perform_run()\n");
+            return;
+        }
+        dependency_count = parse_dependencies(args[2], dependencies, sizeof(dependencies) / sizeof(dependencies[0]));
+        if (dependency_count < 0) {
+            return;
+        }
+        args += 2;
+    }
+    // Ensure there are enough arguments
+    if (args[1] == NULL || args[2] == NULL || args[3] == NULL) {
+        reply_error("Invalid arguments for perform_run()\n");
+        return;
+    }
+    // Ensure that the remaining runtime is valid
+    int64_t runtime;
+    if (!parse_runtime(args[3], &runtime)) {
+        reply_error("Invalid remaining runtime for perform_run(), provide a number > 0 (Optionally with a unit: ns, us, ms, s, m)\n");
+        return;
+    }
+    // Ensure there is space for the new process record (UNUSED slot, else oldest TERMINATED slot, else grow the table)
+    int index = allocate_process_slot();
+    if (index < 0) {
+        // If the table cannot grow any further, print an error message and return
+        reply_error("Maximum number of processes reached\n");
+        return;
+    }
+    if (dependency_count > 0) {
+        pid_t job_id = hold_process(index, args + 1, runtime, WAITING);
+        for (int i = 0; i < dependency_count; ++i) {
+            add_dependency(dependencies[i], index, job_id);
+        }
+        // The critical paths of the queued jobs the new job waits for, directly or not, grow with it
+        if (config.policy == POLICY_CRITICAL_PATH) {
+            rekey_critical_paths();
+        } else {
+            invalidate_critical_paths();
+        }
+        process_records[index].unfinished_dependencies = dependency_count;
+        reply("Job %d waits for %d jobs\n", (int) job_id, dependency_count);
+        reply_with_value(job_id);
+        histogram_record_since(HISTOGRAM_RUN, start);
+        return;
+    }
+    // Under admission control the job waits in the admission queue unless it can be launched now (And nothing queued
+    // before it waits, the queue keeps its order)
+    int64_t memory = -1;
+    if (admission_limited() && (admission_queue.size > 0 || !admission_open(&memory))) {
+        pid_t job_id = hold_process(index, args + 1, runtime, PENDING);
+        reply("Job %d queued for admission\n", (int) job_id);
+        reply_with_value(job_id);
+        histogram_record_since(HISTOGRAM_RUN, start);
+        return;
+    }
+
+    // Queue the process on the least loaded CPU, it starts stopped unless that CPU is idle
+    int cpu = pick_cpu();
+    bool stopped = cpus[cpu].running >= 0;
+    // Create a new process to run and store its information in the process records array
+    // (With the cgroup backend every job starts stopped, it must not fork before it is in its group)
+    int output_read_end;
+    int output_fd = open_output_pipe(&output_read_end);
+	pid_t pid = launch_process(args + 1, stopped || cgroup_root_fd >= 0, output_fd);
+    if (output_fd >= 0) {
+        close(output_fd);
+    }
+	if (pid < 0) {
+		reply_error("Launch failed in perform_run(): %s\n", strerror(errno));
+        if (output_read_end >= 0) {
+            close(output_read_end);
+        }
+        release_process_slot(index);
+		return;
+	}
+    // Store the information of the new process in the process records array
+    admit_process(index, pid, runtime, args[1]);
+    attach_output(index, output_read_end);
+    reply_with_value(pid);
+    if (cgroup_root_fd >= 0) {
+        place_launched_process(index, !stopped);
+    }
+    queue_admitted_process(index, cpu, !stopped);
+    histogram_record_since(HISTOGRAM_RUN, start);
+}
+
+// Run every job of a manifest (One "<prog> <arg> <time>" job per line, like run) with a single reschedule at the end
+// All jobs are launched stopped, queued in bulk (One heap construction per CPU) and then each CPU is scheduled once
+void perform_runbatch(const char * path) {
+    if (path == NULL) {
+        reply_error("Invalid arguments for perform_runbatch()\n");
+        return;
+    }
+    FILE * manifest = fopen(path, "r");
+    if (manifest == NULL) {
+        reply_error("Fopen failed in perform_runbatch(): %s\n", strerror(errno));
+        return;
+    }
+    // Read and validate the jobs
+    batch_job * jobs = NULL;
+    int count = 0;
+    int capacity = 0;
+    char * line = NULL;
+    size_t line_size = 0;
+    int line_number = 0;
+    while (getline(&line, &line_size, manifest) >= 0) {
+        line_number++;
+        if (count == capacity) {
+            capacity = capacity == 0 ? INITIAL_PROCESSES : capacity * 2;
+            batch_job * grown = realloc(jobs, capacity * sizeof(batch_job));
+            if (grown == NULL) {
+                perror("Realloc failed in perform_runbatch()\n");
+                break;
+            }
+            jobs = grown;
+        }
+        batch_job * const job = &jobs[count];
+        job->line = line;
+        int args_count_max = sizeof(job->args) / sizeof(job->args[0]);
+        // Blank lines and comments are skipped
+        if (get_input(line, job->args, args_count_max) == NULL || job->args[0][0] == '#') {
+            continue;
+        }
+        if (job->args[1] == NULL || job->args[2] == NULL || !parse_runtime(job->args[2], &job->runtime)) {
+            reply_error("Invalid job on line %d of %s\n", line_number, path);
+            continue;
+        }
+        // The next line gets its own buffer, the arguments of this job point into this one
+        line = NULL;
+        line_size = 0;
+        count++;
+    }
+    free(line);
+    fclose(manifest);
+    if (admission_limited()) {
+        // Every job goes through the admission queue, the event loop launches them as the limits allow
+        int queued = 0;
+        int index;
+        while (queued < count && (index = allocate_process_slot()) >= 0) {
+            hold_process(index, jobs[queued].args, jobs[queued].runtime, PENDING);
+            queued++;
+        }
+        if (queued < count) {
+            reply_error("Maximum number of processes reached, %d of %d jobs not queued\n", count - queued, count);
+        }
+        reply_with_value(queued);
+        for (int i = 0; i < count; ++i) {
+            free(jobs[i].line);
+        }
+        free(jobs);
+        return;
+    }
+    // Reserve a slot for every job before launching any of them
+    int admitted = 0;
+    while (admitted < count && (jobs[admitted].index = allocate_process_slot()) >= 0) {
+        // Their pipes too: the threads of the spawn pool only launch
+        jobs[admitted].output_fd = open_output_pipe(&jobs[admitted].output_read_end);
+        admitted++;
+    }
+    if (admitted < count) {
+        reply_error("Maximum number of processes reached, %d of %d jobs not started\n", count - admitted, count);
+    }
+    launch_batch(jobs, admitted);
+    // Queue the launched jobs in bulk, balancing them over the CPUs
+    bool * touched = calloc(cpu_count, sizeof(bool));
+    if (touched == NULL) {
+        perror("Calloc failed in perform_runbatch()\n");
+        exit(EXIT_FAILURE);
+    }
+    int started = 0;
+    for (int i = 0; i < admitted; ++i) {
+        batch_job * const job = &jobs[i];
+        if (job->output_fd >= 0) {
+            close(job->output_fd);
+        }
+        if (job->pid < 0) {
+            reply_error("Launch failed in perform_runbatch(): %s\n", strerror(job->error));
+            if (job->output_read_end >= 0) {
+                close(job->output_read_end);
+            }
+            release_process_slot(job->index);
+            continue;
+        }
+        admit_process(job->index, job->pid, job->runtime, job->args[0]);
+        attach_output(job->index, job->output_read_end);
+        if (cgroup_root_fd >= 0) {
+            place_launched_process(job->index, false);
+        }
+        int cpu = pick_cpu();
+        assign_process_cpu(job->index, cpu);
+        ready_queue_append(job->index);
+        touched[cpu] = true;
+        started++;
+    }
+    reply_with_value(started);
+    // Restore the order of every queue first, a CPU being scheduled may steal from another one
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (touched[cpu] && config.ready_queue == READY_QUEUE_HEAP) {
+            ready_queue_heapify(&cpus[cpu].queue);
+        }
+    }
+    // Reschedule once: every CPU that received jobs picks its shortest one
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (touched[cpu]) {
+            schedule_cpu(cpu);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        free(jobs[i].line);
+    }
+    free(jobs);
+    free(touched);
+}
+
+// Print the counters and latency histograms: as text, or as one JSON object (stats json); stats reset clears them
+void perform_stats(const char * format_name) {
+    if (format_name != NULL && strcmp(format_name, "reset") == 0) {
+        reset_statistics();
+        return;
+    }
+    if (format_name != NULL && strcmp(format_name, "json") == 0) {
+        output_buffer * const output = &snapshot_output;
+        output->length = 0;
+        format_statistics_json(output);
+        reply_bytes(output->data, output->length);
+        return;
+    }
+    if (format_name != NULL && strcmp(format_name, "text") != 0) {
+        reply_failure("Unknown stats format: %s (text, json or reset)\n", format_name);
+        return;
+    }
+    reply("reschedules: %llu\n", (unsigned long long) scheduler_stats.reschedules);
+    reply("signals sent: %llu (SIGSTOP %llu, SIGCONT %llu, SIGTERM %llu)\n",
+           (unsigned long long) (scheduler_stats.stops_sent + scheduler_stats.continues_sent + scheduler_stats.terminates_sent),
+           (unsigned long long) scheduler_stats.stops_sent, (unsigned long long) scheduler_stats.continues_sent,
+           (unsigned long long) scheduler_stats.terminates_sent);
+    reply("signals avoided: %llu\n", (unsigned long long) scheduler_stats.signals_avoided);
+    reply("jobs running: %d, resident: %d, pending: %d\n", running_count, resident_count, admission_queue.size);
+    reply("cgroup freezes: %llu, thaws: %llu\n", (unsigned long long) scheduler_stats.freezes,
+           (unsigned long long) scheduler_stats.thaws);
+    if (journal_ring != NULL) {
+        reply("journal records: %llu, dropped: %llu\n",
+              (unsigned long long) atomic_load_explicit(&journal_head, memory_order_relaxed),
+              (unsigned long long) atomic_load_explicit(&journal_dropped, memory_order_relaxed));
+    }
+    reply("events:");
+    for (int source = 0; source < EVENT_SOURCES; ++source) {
+        reply(" %s %llu", event_source_names[source], (unsigned long long) events_handled[source]);
+    }
+    reply("\n");
+    // Latencies in microseconds, percentiles within the 1/16 precision of the histograms
+    for (int id = 0; id < HISTOGRAM_COUNT; ++id) {
+        const latency_histogram * const h = &histograms[id];
+        reply("%s: count %llu, mean %.1fus, p50 %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus\n", histogram_names[id],
+              (unsigned long long) h->count, h->count > 0 ? (double) h->sum / h->count / NS_PER_US : 0.0,
+              (double) histogram_percentile(h, 0.5) / NS_PER_US, (double) histogram_percentile(h, 0.9) / NS_PER_US,
+              (double) histogram_percentile(h, 0.99) / NS_PER_US, (double) h->max / NS_PER_US);
+    }
+}
+
+void perform_list(const char * format_name) {
+    snapshot_format format;
+    if (!parse_snapshot_format(format_name, &format)) {
+        reply_failure("Unknown list format: %s (Use json or bin)\n", format_name);
+        return;
+    }
+    if (format == SNAPSHOT_TEXT) {
+        // To keep track of whether there are any non-UNUSED processes
+        bool found = false;
+        for (int i = 0; i < process_capacity; ++i) {
+            if (PROCESS_STATUS(i) != UNUSED) {
+                found = true;
+                reply("%d, %d\n", PROCESS_PID(i), PROCESS_STATUS(i));
+            }
+        }
+        if (!found) {
+            reply("No processes to list.\n");
+        }
+        return;
+    }
+    write_snapshot(STDOUT_FILENO, format, 0);
+}
+
+// Print the records whose status changed since the previous watch
+void perform_watch(const char * format_name) {
+    snapshot_format format;
+    if (!parse_snapshot_format(format_name, &format)) {
+        reply_failure("Unknown watch format: %s (Use json or bin)\n", format_name);
+        return;
+    }
+    // Every client watches on its own, the user interface has the global watermark
+    uint64_t * const since = current_client >= 0 ? &clients[current_client].watch_sequence : &watch_sequence;
+    write_snapshot(STDOUT_FILENO, format, *since);
+    *since = change_sequence;
+}
+
+// Print the last bytes (4096 unless given) of captured output of a process, what is still in its pipe included
+void perform_logs(pid_t pid, const char * length_text) {
+    if (config.capture == CAPTURE_NONE) {
+        reply_failure("Output capture is off, start the manager with -o.\n");
+        return;
+    }
+    if (pid <= 0) {
+        reply_failure("The process ID must be a positive integer.\n");
+        return;
+    }
+    int i = pid_index_lookup(pid);
+    if (i < 0) {
+        reply_failure("Process %d not found.\n", pid);
+        return;
+    }
+    size_t length = 4096;
+    if (length_text != NULL) {
+        char * end;
+        long long value = strtoll(length_text, &end, 10);
+        if (*length_text == '\0' || *end != '\0' || value <= 0) {
+            reply_failure("Invalid length: %s\n", length_text);
+            return;
+        }
+        length = (size_t) value;
+    }
+    drain_output(i);
+    const process_record * const p = &process_records[i];
+    if (p->output_ring >= 0) {
+        // The ring holds the last CAPTURE_RING_SIZE bytes, in at most two pieces
+        const char * const ring = capture_pool + (size_t) p->output_ring * CAPTURE_RING_SIZE;
+        uint64_t available = p->output_bytes < CAPTURE_RING_SIZE ? p->output_bytes : CAPTURE_RING_SIZE;
+        if (length > available) {
+            length = available;
+        }
+        size_t start = (p->output_bytes - length) % CAPTURE_RING_SIZE;
+        size_t first = length < CAPTURE_RING_SIZE - start ? length : CAPTURE_RING_SIZE - start;
+        reply_bytes(ring + start, first);
+        reply_bytes(ring, length - first);
+        return;
+    }
+    struct stat file_status;
+    if (p->log_fd < 0 || fstat(p->log_fd, &file_status) == -1) {
+        reply_failure("No output captured for process %d.\n", pid);
+        return;
+    }
+    if (length > (size_t) file_status.st_size) {
+        length = file_status.st_size;
+    }
+    char * buffer = malloc(length);
+    if (buffer == NULL) {
+        reply_error("Malloc failed in perform_logs(): %s\n", strerror(errno));
+        return;
+    }
+    ssize_t bytes_read = pread(p->log_fd, buffer, length, file_status.st_size - length);
+    if (bytes_read < 0) {
+        reply_error("Pread failed in perform_logs(): %s\n", strerror(errno));
+    } else {
+        reply_bytes(buffer, bytes_read);
+    }
+    free(buffer);
+}
+
+void perform_stop(pid_t pid) {
+    // Ensure that the process ID given is valid
+    if (pid <= 0) {
+        reply_failure("The process ID must be a positive integer.\n");
+        return;
+    }
+    // Find the process record with the given PID and stop it if it is RUNNING
+    int i = pid_index_lookup(pid);
+    if (i < 0) {
+        reply_failure("Process %d not found.\n", pid);
+        return;
+    }
+    if (PROCESS_STATUS(i) != RUNNING && PROCESS_STATUS(i) != READY) {
+        // If the process is not running, print an error message
+        reply_failure("Process %d is not running.\n", pid);
+        return;
+    }
+    int kill_check = suspend_process(i);
+    // If the kill fails, print an error message
+    if (kill_check == -1) {
+        perror("Kill failed in perform_stop()\n");
+        return;
+    }
+    // If the process was running, update information about the running process
+    if (PROCESS_STATUS(i) == RUNNING) {
+        // Update the remaining runtime of the process to ensure (Scheduler Policy: SJF), then trigger the scheduler
+        int cpu = release_cpu(i);
+        set_process_status(i, STOPPED);
+        schedule_cpu(cpu);
+        return;
+    }
+    set_process_status(i, STOPPED);
+}
+
+void perform_resume(pid_t pid) {
+    // Ensure that the process ID given is valid
+    if (pid <= 0) {
+        reply_failure("The process ID must be a positive integer.\n");
+        return;
+    }
+    // Find the process record with the given PID and resume it if it is STOPPED
+    int i = pid_index_lookup(pid);
+    if (i < 0) {
+        reply_failure("Process %d not found.\n", pid);
+        return;
+    }
+    if (PROCESS_STATUS(i) != STOPPED) {
+        // If the process wasn't not stopped, print an error message
+        reply_failure("Process %d was not in STOPPED status, in order to resume it.\n", pid);
+        return;
+    }
+    // We won't directly resume the process here because the scheduler will decide which process to start
+    int cpu = pick_cpu();
+    assign_process_cpu(i, cpu);
+    set_process_status(i, READY);
+    schedule_cpu(cpu);
+}
+
+void perform_kill(pid_t pid) {
+    // Ensure that the process ID given is valid
+    if (pid <= 0) {
+        reply_failure("The process ID must be a positive integer.\n");
+        return;
+    }
+    // Find the process record with the given PID and terminate it if it is not TERMINATED
+    int i = pid_index_lookup(pid);
+    if (i < 0) {
+        reply_failure("Process %d not found.\n", pid);
+        return;
+    }
+    if (PROCESS_STATUS(i) == TERMINATED) {
+        reply_failure("Process %d is already terminated.\n", pid);
+        return;
+    }
+    if (PROCESS_STATUS(i) == PENDING || PROCESS_STATUS(i) == WAITING) {
+        // Never launched, it only leaves the admission queue (Or stops waiting)
+        release_pending_command(i);
+        set_process_status(i, TERMINATED);
+        release_dependents(i, false);
+        return;
+    }
+    int kill_check = terminate_process(i);
+    // If the kill fails, print an error message
+    if (kill_check == -1) {
+        perror("Kill failed in perform_kill()\n");
+        return;
+    }
+    // The jobs waiting on it are cancelled now, it will not exit successfully
+    release_dependents(i, false);
+    // If the process was running, update its remaining runtime just for accuracy purposes
+    if (PROCESS_STATUS(i) == RUNNING) {
+        // If the process was running, free its CPU and trigger the scheduler
+        int cpu = release_cpu(i);
+        set_process_status(i, TERMINATED);
+        schedule_cpu(cpu);
+        return;
+    }
+    set_process_status(i, TERMINATED);
+}
+
+void perform_exit(void) {
+    // Loop through process records and terminate all processes
+    for (int i = 0; i < process_capacity; ++i) {
+        if (PROCESS_STATUS(i) == PENDING || PROCESS_STATUS(i) == WAITING) {
+            release_pending_command(i);
+            set_process_status(i, TERMINATED);
+        } else if (PROCESS_STATUS(i) != UNUSED && PROCESS_STATUS(i) != TERMINATED) {
+            int kill_check = terminate_process(i);
+            // If the kill fails, print an error message
+            if (kill_check == -1) {
+                perror("Kill failed in perform_exit()... continuing exit function\n");
+            }
+            set_process_status(i, TERMINATED);
+        }
+        // What is left in the pipes still goes to the log files
+        if (process_records[i].output_fd >= 0) {
+            drain_output(i);
+        }
+    }
+    remove_state_file();
+    // Print a message and exit the program
+	reply("Exiting the process manager!\n");
+}
+
+/*
+    COORDINATOR (Coordinator mode: no jobs of its own, every command is forwarded to the control sockets of other
+    managers, placing each run on one of them and aggregating list, watch and stats over all of them)
+*/
+
+// Order of the points of the consistent hashing ring
+int compare_ring_points(const void * a, const void * b) {
+    const uint64_t hash_a = ((const ring_point *) a)->hash;
+    const uint64_t hash_b = ((const ring_point *) b)->hash;
+    return hash_a < hash_b ? -1 : hash_a > hash_b;
+}
+
+// Split the list of nodes and build the hashing ring (The nodes are connected on first use)
+void setup_coordinator(void) {
+    char * list = strdup(config.coordinator_nodes);
+    nodes = calloc(COORDINATOR_NODES_MAX, sizeof(coordinator_node));
+    hash_ring = calloc(COORDINATOR_NODES_MAX * COORDINATOR_RING_POINTS, sizeof(ring_point));
+    if (list == NULL || nodes == NULL || hash_ring == NULL) {
+        perror("Allocation failed in setup_coordinator\n");
+        exit(EXIT_FAILURE);
+    }
+    for (char * path = strtok(list, ","); path != NULL; path = strtok(NULL, ",")) {
+        if (node_count == COORDINATOR_NODES_MAX) {
+            fprintf(stderr, "At most %d nodes can be coordinated\n", COORDINATOR_NODES_MAX);
+            exit(EXIT_FAILURE);
+        }
+        if (strlen(path) >= sizeof(((struct sockaddr_un *) NULL)->sun_path)) {
+            fprintf(stderr, "Node socket path too long: %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+        coordinator_node * const n = &nodes[node_count];
+        n->path = path;
+        n->fd = -1;
+        for (int point = 0; point < COORDINATOR_RING_POINTS; ++point) {
+            char name[sizeof(((struct sockaddr_un *) NULL)->sun_path) + 16];
+            snprintf(name, sizeof(name), "%s#%d", path, point);
+            hash_ring[ring_size++] = (ring_point) {.hash = estimate_key(name), .node = node_count};
+        }
+        node_count++;
+    }
+    if (node_count == 0) {
+        fprintf(stderr, "No node to coordinate\n");
+        exit(EXIT_FAILURE);
+    }
+    qsort(hash_ring, ring_size, sizeof(ring_point), compare_ring_points);
+}
+
+// Close the connection to a node, the requests it had not answered are lost with it
+void node_disconnect(coordinator_node * n) {
+    if (n->fd >= 0) {
+        close(n->fd);
+    }
+    n->fd = -1;
+    n->outstanding = 0;
+}
+
+// Connect to a node unless it is connected already (Returns false if it is unavailable)
+bool node_connect(coordinator_node * n) {
+    if (n->fd >= 0) {
+        return true;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Socket failed in node_connect\n");
+        return false;
+    }
+    // A node that stops answering fails the request instead of blocking the coordinator
+    struct timeval timeout = {.tv_sec = COORDINATOR_TIMEOUT_SEC, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, n->path, strlen(n->path));
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        close(fd);
+        return false;
+    }
+    n->fd = fd;
+    n->outstanding = 0;
+    return true;
+}
+
+// Send a request to a node without waiting for its response
+bool node_send(coordinator_node * n, const char * request, size_t length) {
+    if (!node_connect(n)) {
+        return false;
+    }
+    while (send(n->fd, request, length, MSG_NOSIGNAL) == -1) {
+        if (errno != EINTR) {
+            node_disconnect(n);
+            return false;
+        }
+    }
+    n->outstanding++;
+    requests_forwarded++;
+    return true;
+}
+
+// Read the next response of a node (Every message of it) into the node's status, value and response
+bool node_receive(coordinator_node * n) {
+    static char message[sizeof(response_header) + RESPONSE_CHUNK];
+    n->response.length = 0;
+    n->status = RESPONSE_OK;
+    n->value = 0;
+    if (n->fd < 0 || n->outstanding == 0) {
+        return false;
+    }
+    response_header header;
+    do {
+        ssize_t length = recv(n->fd, message, sizeof(message), 0);
+        if (length == -1 && errno == EINTR) {
+            header.flags = RESPONSE_MORE;
+            continue;
+        }
+        if (length < (ssize_t) sizeof(header)) {
+            // Gone or timed out: the responses still outstanding are lost with the connection
+            node_disconnect(n);
+            return false;
+        }
+        memcpy(&header, message, sizeof(header));
+        if (header.length > (size_t) length - sizeof(header)) {
+            // A reply shorter than it claims (Or truncated) is not from a manager, nothing after it can be trusted
+            fprintf(stderr, "Malformed reply from node %s\n", n->path);
+            node_disconnect(n);
+            return false;
+        }
+        output_reserve(&n->response, header.length);
+        memcpy(n->response.data + n->response.length, message + sizeof(header), header.length);
+        n->response.length += header.length;
+        n->status = header.status;
+        n->value = header.value;
+    } while (header.flags & RESPONSE_MORE);
+    n->outstanding--;
+    return true;
+}
+
+// Send the request being built to a node and wait for its response (One round trip)
+bool node_exchange(int node) {
+    coordinator_node * const n = &nodes[node];
+    forward_batches++;
+    if (!node_send(n, coordinator_request.data, coordinator_request.length) || !node_receive(n)) {
+        reply_failure("Node %s is unavailable\n", n->path);
+        return false;
+    }
+    return true;
+}
+
+// Send the request being built to every node at once, their responses are then read in turn (One round trip)
+void node_broadcast(void) {
+    forward_batches++;
+    for (int node = 0; node < node_count; ++node) {
+        node_send(&nodes[node], coordinator_request.data, coordinator_request.length);
+    }
+}
+
+// Id of a job of a node at the coordinator, and back (False for an id that names no node)
+int64_t global_job_id(int node, int64_t id) {
+    return id * COORDINATOR_NODES_MAX + node;
+}
+
+bool split_job_id(const char * text, int * node, long long * id) {
+    char * end;
+    long long global = strtoll(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || global <= 0) {
+        return false;
+    }
+    *node = (int) (global % COORDINATOR_NODES_MAX);
+    *id = global / COORDINATOR_NODES_MAX;
+    return *node < node_count && *id > 0 && *id <= INT_MAX;
+}
+
+// Output of the last response of a node as the reply of the coordinator, with the job id of its value made global
+void relay_response(int node, bool job_value) {
+    const coordinator_node * const n = &nodes[node];
+    if (n->status == RESPONSE_OK) {
+        reply("%.*s", (int) n->response.length, n->response.data);
+    } else {
+        reply_failure("%.*s", (int) n->response.length, n->response.data);
+    }
+    reply_with_value(job_value && n->value > 0 ? global_job_id(node, n->value) : n->value);
+}
+
+// Ask every node for its load when the loads are older than COORDINATOR_LOAD_REFRESH
+void refresh_node_loads(void) {
+    int64_t now = monotonic_ns();
+    if (loads_refreshed_at != 0 && now - loads_refreshed_at < COORDINATOR_LOAD_REFRESH) {
+        return;
+    }
+    // Not in the middle of a batch, the responses of the nodes would be out of order (Placements are counted anyway)
+    for (int node = 0; node < node_count; ++node) {
+        if (nodes[node].outstanding > 0) {
+            return;
+        }
+    }
+    loads_refreshed_at = now;
+    coordinator_request.length = 0;
+    output_printf(&coordinator_request, "stats json");
+    node_broadcast();
+    for (int node = 0; node < node_count; ++node) {
+        coordinator_node * const n = &nodes[node];
+        if (!node_receive(n)) {
+            continue;
+        }
+        output_reserve(&n->response, 1);
+        n->response.data[n->response.length] = '\0';
+        const char * resident = strstr(n->response.data, "\"resident\":");
+        const char * pending = strstr(n->response.data, "\"pending\":");
+        n->reported_load = 0;
+        if (resident != NULL) {
+            n->reported_load += strtoll(resident + strlen("\"resident\":"), NULL, 10);
+        }
+        if (pending != NULL) {
+            n->reported_load += strtoll(pending + strlen("\"pending\":"), NULL, 10);
+        }
+        n->placed = 0;
+    }
+}
+
+// Node a job of a program is placed on (-1 when no node is available)
+int place_job(const char * program) {
+    if (config.placement == PLACEMENT_HASH) {
+        // First point of the ring at or after the hash of the program, an unavailable node passes on to the next one
+        const uint64_t key = estimate_key(program);
+        int low = 0;
+        int high = ring_size;
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (hash_ring[middle].hash < key) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (int k = 0; k < ring_size; ++k) {
+            const int node = hash_ring[(low + k) % ring_size].node;
+            if (node_connect(&nodes[node])) {
+                return node;
+            }
+        }
+        return -1;
+    }
+    refresh_node_loads();
+    int best = -1;
+    for (int node = 0; node < node_count; ++node) {
+        const coordinator_node * const n = &nodes[node];
+        if (!node_connect(&nodes[node])) {
+            continue;
+        }
+        if (best < 0 || n->reported_load + n->placed < nodes[best].reported_load + nodes[best].placed) {
+            best = node;
+        }
+    }
+    return best;
+}
+
+// Build a run request for a node from the tokens of a job ("<prog> <arg> <time>", as in run and runbatch)
+void build_run_request(char * job[]) {
+    coordinator_request.length = 0;
+    output_printf(&coordinator_request, "run");
+    for (int i = 0; job[i] != NULL; ++i) {
+        output_printf(&coordinator_request, " %s", job[i]);
+    }
+}
+
+// run: placed on a node, or on the node of its dependencies with --after (Dependencies do not span nodes)
+void coordinate_run(char * args[]) {
+    int node = -1;
+    char * after = NULL;
+    char ** job = args + 1;
+    if (args[1] != NULL && strcmp(args[1], "--after") == 0 && args[2] != NULL) {
+        after = args[2];
+        job = args + 3;
+    }
+    if (job[0] == NULL) {
+        reply_error("Invalid arguments for perform_run()\n");
+        return;
+    }
+    if (after != NULL) {
+        // The ids of the dependencies, translated to the ids of their node
+        char dependencies[256] = "";
+        size_t used = 0;
+        for (char * item = strtok(after, ","); item != NULL; item = strtok(NULL, ",")) {
+            int item_node;
+            long long id;
+            if (!split_job_id(item, &item_node, &id)) {
+                reply_failure("Process %s not found.\n", item);
+                return;
+            }
+            if (node >= 0 && item_node != node) {
+                reply_failure("Dependencies on several nodes are not supported.\n");
+                return;
+            }
+            node = item_node;
+            used += snprintf(dependencies + used, sizeof(dependencies) - used, "%s%lld", used > 0 ? "," : "", id);
+            if (used >= sizeof(dependencies)) {
+                reply_failure("Too many dependencies.\n");
+                return;
+            }
+        }
+        coordinator_request.length = 0;
+        output_printf(&coordinator_request, "run --after %s", dependencies);
+        for (int i = 0; job[i] != NULL; ++i) {
+            output_printf(&coordinator_request, " %s", job[i]);
+        }
+    } else {
+        // Placed first, a load refresh sends requests of its own
+        node = place_job(job[0]);
+        build_run_request(job);
+    }
+    if (node < 0) {
+        reply_failure("No node is available\n");
+        return;
+    }
+    if (node_exchange(node)) {
+        if (nodes[node].status == RESPONSE_OK) {
+            nodes[node].placed++;
+        }
+        relay_response(node, true);
+    }
+}
+
+// Read the responses a node still owes to the runs of a batch (Returns the number of jobs started)
+int collect_batch_responses(coordinator_node * n) {
+    int started = 0;
+    while (n->outstanding > 0) {
+        if (!node_receive(n)) {
+            reply_failure("Node %s is unavailable, the rest of its jobs are lost\n", n->path);
+            break;
+        }
+        if (n->status == RESPONSE_OK) {
+            n->placed++;
+            started++;
+        } else {
+            reply_failure("%.*s", (int) n->response.length, n->response.data);
+        }
+    }
+    return started;
+}
+
+// runbatch: the manifest is read here, its jobs placed one by one and pipelined to their nodes (Up to
+// COORDINATOR_WINDOW requests in flight per node, then the node's responses are read)
+void coordinate_runbatch(const char * path) {
+    if (path == NULL) {
+        reply_error("Invalid arguments for perform_runbatch()\n");
+        return;
+    }
+    FILE * manifest = fopen(path, "r");
+    if (manifest == NULL) {
+        reply_error("Fopen failed in perform_runbatch(): %s\n", strerror(errno));
+        return;
+    }
+    int started = 0;
+    char * line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, manifest) >= 0) {
+        char * job[10];
+        if (get_input(line, job, sizeof(job) / sizeof(job[0])) == NULL || job[0][0] == '#') {
+            continue;
+        }
+        int node = place_job(job[0]);
+        if (node < 0) {
+            reply_failure("No node is available\n");
+            break;
+        }
+        coordinator_node * const n = &nodes[node];
+        if (n->outstanding == 0) {
+            forward_batches++;
+        }
+        build_run_request(job);
+        if (!node_send(n, coordinator_request.data, coordinator_request.length)) {
+            reply_failure("Node %s is unavailable\n", n->path);
+            continue;
+        }
+        if (n->outstanding == COORDINATOR_WINDOW) {
+            started += collect_batch_responses(n);
+        }
+    }
+    free(line);
+    fclose(manifest);
+    for (int node = 0; node < node_count; ++node) {
+        started += collect_batch_responses(&nodes[node]);
+    }
+    reply_with_value(started);
+}
+
+// stop, resume, kill and logs: forwarded to the node of the job, with its id there
+void coordinate_job_command(char * args[]) {
+    int node;
+    long long id;
+    if (args[1] == NULL || !split_job_id(args[1], &node, &id)) {
+        reply_failure("Process %s not found.\n", args[1] != NULL ? args[1] : "");
+        return;
+    }
+    coordinator_request.length = 0;
+    output_printf(&coordinator_request, "%s %lld", args[0], id);
+    for (int i = 2; args[i] != NULL; ++i) {
+        output_printf(&coordinator_request, " %s", args[i]);
+    }
+    if (node_exchange(node)) {
+        relay_response(node, false);
+    }
+}
+
+// list and watch: asked of every node at once, their lines merged with the pids made global (JSON lines get the node)
+void coordinate_snapshot(char * args[]) {
+    if (args[1] != NULL && strcmp(args[1], "bin") == 0) {
+        reply_failure("Binary snapshots are not supported by the coordinator\n");
+        return;
+    }
+    const bool json = args[1] != NULL && strcmp(args[1], "json") == 0;
+    coordinator_request.length = 0;
+    output_printf(&coordinator_request, "%s%s%s", args[0], args[1] != NULL ? " " : "", args[1] != NULL ? args[1] : "");
+    node_broadcast();
+    for (int node = 0; node < node_count; ++node) {
+        coordinator_node * const n = &nodes[node];
+        if (!node_receive(n)) {
+            reply_failure("Node %s is unavailable\n", n->path);
+            continue;
+        }
+        if (n->status != RESPONSE_OK) {
+            relay_response(node, false);
+            continue;
+        }
+        // Terminated, so the pids can be parsed in place
+        output_reserve(&n->response, 1);
+        n->response.data[n->response.length] = '\0';
+        const char * const prefix = json ? "{\"pid\":" : "";
+        const size_t prefix_length = strlen(prefix);
+        const char * line = n->response.data;
+        const char * const end = line + n->response.length;
+        while (line < end) {
+            const char * next = memchr(line, '\n', end - line);
+            next = next != NULL ? next + 1 : end;
+            char * rest = NULL;
+            long long pid = 0;
+            if ((size_t) (next - line) > prefix_length && memcmp(line, prefix, prefix_length) == 0) {
+                pid = strtoll(line + prefix_length, &rest, 10);
+            }
+            if (pid > 0 && json) {
+                reply("{\"node\":%d,\"pid\":%lld%.*s", node, (long long) global_job_id(node, pid), (int) (next - rest), rest);
+            } else if (pid > 0) {
+                reply("%lld%.*s", (long long) global_job_id(node, pid), (int) (next - rest), rest);
+            } else {
+                reply("%.*s", (int) (next - line), line);
+            }
+            line = next;
+        }
+    }
+}
+
+// stats: the counters of the coordinator, then those of every node (stats json: one object holding every node's)
+void coordinate_stats(char * args[]) {
+    const char * const format = args[1] != NULL ? args[1] : "text";
+    const bool json = strcmp(format, "json") == 0;
+    if (strcmp(format, "reset") == 0) {
+        reset_statistics();
+        requests_forwarded = forward_batches = 0;
+    } else if (!json && strcmp(format, "text") != 0) {
+        reply_failure("Unknown stats format: %s (text, json or reset)\n", format);
+        return;
+    }
+    coordinator_request.length = 0;
+    output_printf(&coordinator_request, "stats %s", format);
+    node_broadcast();
+    if (json) {
+        reply("{\"coordinator\":{\"nodes\":%d,\"requests_forwarded\":%llu,\"batches\":%llu},\"nodes\":[", node_count,
+              (unsigned long long) requests_forwarded, (unsigned long long) forward_batches);
+    } else if (strcmp(format, "text") == 0) {
+        reply("coordinator: %d nodes, %llu requests forwarded in %llu batches\n", node_count,
+              (unsigned long long) requests_forwarded, (unsigned long long) forward_batches);
+    }
+    for (int node = 0; node < node_count; ++node) {
+        coordinator_node * const n = &nodes[node];
+        const bool answered = node_receive(n) && n->status == RESPONSE_OK;
+        // The JSON object of a node without its newline, null for a node that did not answer
+        size_t length = n->response.length;
+        if (json) {
+            while (length > 0 && n->response.data[length - 1] == '\n') {
+                length--;
+            }
+            reply("%s%.*s", node > 0 ? "," : "", answered ? (int) length : 4, answered ? n->response.data : "null");
+        } else if (!answered) {
+            reply_failure("Node %s is unavailable\n", n->path);
+        } else if (length > 0) {
+            reply("node %d (%s):\n%.*s", node, n->path, (int) length, n->response.data);
+        }
+    }
+    if (json) {
+        reply("]}\n");
+    }
+}
+
+// Execute a command in coordinator mode (Returns false on exit, which is forwarded to every node first)
+bool coordinate_command(char * buffer) {
+    char * args[10];
+    int args_count_max = sizeof(args) / sizeof(args[0]);
+    char * command = get_input(buffer, args, args_count_max);
+    if (command == NULL) {
+        return true;
+    }
+    if (strcmp(command, "run") == 0) {
+        coordinate_run(args);
+    } else if (strcmp(command, "runbatch") == 0) {
+        coordinate_runbatch(args[1]);
+    } else if (strcmp(command, "stop") == 0 || strcmp(command, "resume") == 0 || strcmp(command, "kill") == 0 ||
+               strcmp(command, "logs") == 0) {
+        coordinate_job_command(args);
+    } else if (strcmp(command, "list") == 0 || strcmp(command, "watch") == 0) {
+        coordinate_snapshot(args);
+    } else if (strcmp(command, "stats") == 0) {
+        coordinate_stats(args);
+    } else if (strcmp(command, "exit") == 0) {
+        coordinator_request.length = 0;
+        output_printf(&coordinator_request, "exit");
+        node_broadcast();
+        for (int node = 0; node < node_count; ++node) {
+            node_receive(&nodes[node]);
+            node_disconnect(&nodes[node]);
+        }
+        perform_exit();
+        return false;
+    } else {
+        reply_failure("Unknown command: %s\n", command);
+    }
+    return true;
+}
+
+/*
+    EVENT LOOP: COMMAND PIPE, SIGCHLD AND RUNTIME ACCOUNTING TIMER
+*/
+
+// Create the epoll instance and register the command pipe, the SIGCHLD signalfd and the accounting timerfd
+void setup_event_loop(int command_fd) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("Epoll_create1 failed in setup_event_loop\n");
+        exit(EXIT_FAILURE);
+    }
+    setup_signal_fd();
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("Timerfd_create failed in setup_event_loop\n");
+        exit(EXIT_FAILURE);
+    }
+    add_event_source(command_fd, EVENT_COMMAND_PIPE, 0, EPOLLIN);
+    add_event_source(signal_fd, EVENT_SIGNAL, 0, EPOLLIN);
+    add_event_source(timer_fd, EVENT_TIMER, 0, EPOLLIN);
+    quantum_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (quantum_fd == -1) {
+        perror("Timerfd_create failed in setup_event_loop\n");
+        exit(EXIT_FAILURE);
+    }
+    add_event_source(quantum_fd, EVENT_QUANTUM, 0, EPOLLIN);
+    mlfq_next_boost = monotonic_ns() + config.mlfq_boost;
+    if (config.stats_file != NULL) {
+        stats_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (stats_fd == -1) {
+            perror("Timerfd_create failed in setup_event_loop\n");
+            exit(EXIT_FAILURE);
+        }
+        struct itimerspec spec = {
+            .it_interval = {.tv_sec = config.stats_interval / NS_PER_SEC, .tv_nsec = config.stats_interval % NS_PER_SEC},
+            .it_value = {.tv_sec = config.stats_interval / NS_PER_SEC, .tv_nsec = config.stats_interval % NS_PER_SEC}
+        };
+        if (timerfd_settime(stats_fd, 0, &spec, NULL) == -1) {
+            perror("Timerfd_settime failed in setup_event_loop\n");
+            exit(EXIT_FAILURE);
+        }
+        add_event_source(stats_fd, EVENT_STATS, 0, EPOLLIN);
+    }
+}
+
+// Arm the accounting timer while a process is running and disarm it otherwise, so an idle manager never wakes up
+void update_accounting_timer(void) {
+    bool should_arm = running_count > 0;
+    if (should_arm == accounting_timer_armed) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (should_arm) {
+        // Every transition charges exactly, the tick only keeps the runtimes of long running processes current
+        spec.it_value.tv_sec = 1;
+        spec.it_interval.tv_sec = 1;
+    }
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) == -1) {
+        perror("Timerfd_settime failed in update_accounting_timer\n");
+        return;
+    }
+    accounting_timer_armed = should_arm;
+}
+
+// Arm the quantum timer for the earliest end of a time slice, or disarm it when no running process has a slice
+void update_quantum_timer(void) {
+    int64_t earliest = 0;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (cpus[cpu].running >= 0 && cpus[cpu].slice_end > 0 && (earliest == 0 || cpus[cpu].slice_end < earliest)) {
+            earliest = cpus[cpu].slice_end;
+        }
+    }
+    if (earliest == quantum_armed_for) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    // An absolute expiry on the same clock as monotonic_ns (Zero disarms the timer)
+    spec.it_value.tv_sec = earliest / NS_PER_SEC;
+    spec.it_value.tv_nsec = earliest % NS_PER_SEC;
+    if (timerfd_settime(quantum_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        perror("Timerfd_settime failed in update_quantum_timer\n");
+        return;
+    }
+    quantum_armed_for = earliest;
+}
+
+// Update the remaining runtime of the running processes, called on every accounting timer expiration
+void update_running_runtime(void) {
+    uint64_t expirations;
+    // Consume the expiration count, otherwise the timerfd stays readable
+    while (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+    }
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (cpus[cpu].running >= 0) {
+            charge_process(cpus[cpu].running);
+        }
+    }
+}
+
+// Execute one command read from the user interface, returns false once the manager should exit
+bool dispatch_command(char * buffer) {
+    char * args[10];
+    int args_count_max = sizeof(args) / sizeof(args[0]);
+    // Get the command and arguments from the input
+    if (node_count > 0) {
+        return coordinate_command(buffer);
+    }
+    char * command = get_input(buffer, args, args_count_max);
+    if (command == NULL) {
+        // Blank line, nothing to do
+        return true;
+    }
+    if (strcmp(command, "run") == 0) {
+        perform_run(args);
+    } else if (strcmp(command, "runbatch") == 0) {
+        perform_runbatch(args[1]);
+    } else if (strcmp(command, "stop") == 0) {
+        perform_stop(args[1] != NULL ? atoi(args[1]) : 0);
+    } else if (strcmp(command, "resume") == 0) {
+        perform_resume(args[1] != NULL ? atoi(args[1]) : 0);
+    } else if (strcmp(command, "kill") == 0) {
+        perform_kill(args[1] != NULL ? atoi(args[1]) : 0);
+    } else if (strcmp(command, "list") == 0) {
+        perform_list(args[1]);
+    } else if (strcmp(command, "watch") == 0) {
+        perform_watch(args[1]);
+    } else if (strcmp(command, "logs") == 0) {
+        perform_logs(args[1] != NULL ? atoi(args[1]) : 0, args[1] != NULL ? args[2] : NULL);
+    } else if (strcmp(command, "stats") == 0) {
+        perform_stats(args[1]);
+    } else if (strcmp(command, "exit") == 0) {
+        perform_exit();
+        return false;
+    } else {
+        reply_failure("Unknown command: %s\n", command);
+    }
+    return true;
+}
+
+// Execute one command, timing it from its read to its dispatch and its execution
+bool execute_command(char * buffer) {
+    int64_t dispatched = histogram_record_since(HISTOGRAM_COMMAND_LATENCY, command_read_at);
+    bool running = dispatch_command(buffer);
+    histogram_record_since(HISTOGRAM_COMMAND, dispatched);
+    return running;
+}
+
+// Execute every complete command held by the reader and keep the trailing partial one, returns false on exit
+bool execute_buffered_commands(command_reader * reader) {
+    size_t start = 0;
+    bool running = true;
+    while (running) {
+        char * newline = memchr(reader->data + start, '\n', reader->length - start);
+        if (newline == NULL) {
+            break;
+        }
+        // Commands are newline-delimited, terminate this one in place and execute it
+        *newline = '\0';
+        running = execute_command(reader->data + start);
+        start = newline - reader->data + 1;
+    }
+    // Move the partial command (If any) to the front of the buffer for the next read
+    memmove(reader->data, reader->data + start, reader->length - start);
+    reader->length -= start;
+    return running;
+}
+
+// Read everything available on the pipe and execute the complete commands, returns false once the manager should exit
+bool handle_command_pipe(int command_fd) {
+    command_reader * const reader = &pipe_reader;
+    while (true) {
+        // Keep room for a large read so several commands can be pulled with a single read()
+        if (reader->capacity - reader->length < 4096) {
+            size_t capacity = reader->capacity == 0 ? 65536 : reader->capacity * 2;
+            char * data = realloc(reader->data, capacity);
+            if (data == NULL) {
+                perror("Realloc failed in handle_command_pipe\n");
+                perform_exit();
+                return false;
+            }
+            reader->data = data;
+            reader->capacity = capacity;
+        }
+        ssize_t bytes_read = read(command_fd, reader->data + reader->length, reader->capacity - reader->length);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: the pipe is drained for now, the partial command (If any) waits for the next event
+            return errno == EAGAIN;
+        }
+        if (bytes_read == 0) {
+            // The user interface closed the pipe, execute a final unterminated command and exit
+            bool running = true;
+            if (reader->length > 0) {
+                command_read_at = monotonic_ns();
+                reader->data[reader->length] = '\0';
+                running = execute_command(reader->data);
+                reader->length = 0;
+            }
+            if (running) {
+                perform_exit();
+            }
+            return false;
+        }
+        reader->length += bytes_read;
+        command_read_at = monotonic_ns();
+        if (!execute_buffered_commands(reader)) {
+            return false;
+        }
+    }
+}
+
+/*
+    CONTROL SOCKET (SOCK_SEQPACKET Unix socket: one request per message, any number of concurrent clients)
+*/
+
+// Create the listening control socket and register it with the event loop
+void setup_control_socket(void) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(config.listen_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Control socket path too long: %s\n", config.listen_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, config.listen_path);
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        perror("Socket failed in setup_control_socket\n");
+        exit(EXIT_FAILURE);
+    }
+    // A socket left behind by a previous manager would make bind fail
+    unlink(config.listen_path);
+    if (bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(listen_fd, SOMAXCONN) == -1) {
+        perror("Bind failed in setup_control_socket\n");
+        exit(EXIT_FAILURE);
+    }
+    add_event_source(listen_fd, EVENT_LISTEN, 0, EPOLLIN);
+}
+
+// Remove the control socket from the file system when the manager exits
+void close_control_socket(void) {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(config.listen_path);
+        listen_fd = -1;
+    }
+}
+
+// Change the events a registered file descriptor is waited for
+void modify_event_source(int fd, event_source source, uint32_t id, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = ((uint64_t) source << 32) | id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        perror("Epoll_ctl failed in modify_event_source\n");
+    }
+}
+
+void close_client(int slot) {
+    control_client * const c = &clients[slot];
+    close(c->fd);
+    c->fd = -1;
+    free(c->pending.data);
+    memset(&c->pending, 0, sizeof(c->pending));
+    c->sent = 0;
+}
+
+// Accept every pending connection, each client gets a slot (Reused after it disconnects)
+void accept_clients(void) {
+    while (true) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EINTR) {
+                perror("Accept4 failed in accept_clients\n");
+            }
+            if (errno != EINTR) {
+                return;
+            }
+            continue;
+        }
+        int slot = 0;
+        while (slot < client_capacity && clients[slot].fd >= 0) {
+            slot++;
+        }
+        if (slot == client_capacity) {
+            int capacity = client_capacity == 0 ? 16 : client_capacity * 2;
+            control_client * grown = realloc(clients, capacity * sizeof(control_client));
+            if (grown == NULL) {
+                perror("Realloc failed in accept_clients\n");
+                close(fd);
+                continue;
+            }
+            memset(grown + client_capacity, 0, (capacity - client_capacity) * sizeof(control_client));
+            for (int i = client_capacity; i < capacity; ++i) {
+                grown[i].fd = -1;
+            }
+            clients = grown;
+            client_capacity = capacity;
+        }
+        control_client * const c = &clients[slot];
+        c->fd = fd;
+        c->sent = 0;
+        c->waiting_to_send = false;
+        c->watch_sequence = 0;
+        add_event_source(fd, EVENT_CLIENT, slot, EPOLLIN);
+    }
+}
+
+// Queue one message for a client (Stored as its length followed by its bytes)
+void queue_client_message(control_client * c, const response_header * header, const char * payload) {
+    uint32_t length = sizeof(*header) + header->length;
+    output_reserve(&c->pending, sizeof(length) + length);
+    char * const frame = c->pending.data + c->pending.length;
+    memcpy(frame, &length, sizeof(length));
+    memcpy(frame + sizeof(length), header, sizeof(*header));
+    memcpy(frame + sizeof(length) + sizeof(*header), payload, header->length);
+    c->pending.length += sizeof(length) + length;
+}
+
+// Send the pending messages of a client until its socket is full, then wait for EPOLLOUT; returns false if it is gone
+bool flush_client(int slot) {
+    control_client * const c = &clients[slot];
+    while (c->sent < c->pending.length) {
+        uint32_t length;
+        memcpy(&length, c->pending.data + c->sent, sizeof(length));
+        ssize_t written = send(c->fd, c->pending.data + c->sent + sizeof(length), length, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return false;
+        }
+        c->sent += sizeof(length) + length;
+    }
+    if (c->sent == c->pending.length) {
+        c->pending.length = 0;
+        c->sent = 0;
+    }
+    bool waiting = c->pending.length > 0;
+    if (waiting != c->waiting_to_send) {
+        modify_event_source(c->fd, EVENT_CLIENT, slot, waiting ? EPOLLIN | EPOLLOUT : EPOLLIN);
+        c->waiting_to_send = waiting;
+    }
+    return true;
+}
+
+// Execute one request of a client and queue its response (Split in messages of at most RESPONSE_CHUNK bytes)
+bool execute_client_request(int slot, char * request) {
+    current_client = slot;
+    reply_output.length = 0;
+    reply_status = RESPONSE_OK;
+    reply_value = 0;
+    bool running = execute_command(request);
+    current_client = -1;
+    size_t offset = 0;
+    do {
+        size_t length = reply_output.length - offset;
+        if (length > RESPONSE_CHUNK) {
+            length = RESPONSE_CHUNK;
+        }
+        response_header header = {
+            .status = reply_status,
+            .flags = offset + length < reply_output.length ? RESPONSE_MORE : 0,
+            .length = (uint32_t) length,
+            .value = reply_value
+        };
+        queue_client_message(&clients[slot], &header, reply_output.data + offset);
+        offset += length;
+    } while (offset < reply_output.length);
+    return running;
+}
+
+// Handle the events of a client: every queued request is executed, then the responses are sent; returns false on exit
+bool handle_client(int slot, uint32_t events) {
+    if (slot >= client_capacity || clients[slot].fd < 0) {
+        // Stale event of a client closed earlier in the same batch
+        return true;
+    }
+    bool running = true;
+    bool open = true;
+    if (events & EPOLLIN) {
+        char request[REQUEST_SIZE_MAX + 1];
+        while (running) {
+            ssize_t length = recv(clients[slot].fd, request, REQUEST_SIZE_MAX, 0);
+            if (length < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                open = errno == EAGAIN;
+                break;
+            }
+            if (length == 0) {
+                open = false;
+                break;
+            }
+            command_read_at = monotonic_ns();
+            request[length] = '\0';
+            // A request may end with the newline the pipe protocol uses
+            if (request[length - 1] == '\n') {
+                request[length - 1] = '\0';
+            }
+            running = execute_client_request(slot, request);
+        }
+    }
+    if (open && (events & (EPOLLHUP | EPOLLERR)) && !(events & EPOLLIN)) {
+        open = false;
+    }
+    // Responses already queued are still sent when the client is gone from reading, not when it is closed
+    if (!flush_client(slot) || !open) {
+        close_client(slot);
+    }
+    return running;
+}
+
+/*
+    SIMULATION (Replays a trace against a virtual clock with synthetic processes, through the scheduler of the manager)
+*/
+
+// A job of a trace: arrival time, runtime it needs to finish and runtime budget the scheduler sees (ns)
+typedef struct trace_job {
+    int64_t arrival;
+    int64_t work;
+    int64_t budget;
+} trace_job;
+
+// Reader of a text trace: one "<arrival> <runtime> [<budget>]" job per line in arrival order, times in the syntax of
+// the runtime budgets (An arrival may also be 0), the budget defaulting to the runtime; blank lines and # comments.
+// A journal file is a trace as well, its jobs are loaded up front (See load_journal_trace())
+typedef struct trace_reader {
+    FILE * file;
+    char * line;
+    size_t line_size;
+    long line_number;
+    // Jobs of a journal, and the next one to arrive
+    bool journal;
+    trace_job * jobs;
+    size_t job_count;
+    size_t next_job;
+} trace_reader;
+
+// Entry of the job index of load_journal_trace() (Key 0 marks an empty entry)
+typedef struct journal_job_entry {
+    int32_t key;
+    int32_t job;
+} journal_job_entry;
+
+// Load the jobs of a journal file, returns false (And rewinds) if the trace is not one: a job arrives when its record
+// leaves UNUSED or TERMINATED, with the remaining runtime of that record as its budget, and its work is the runtime
+// it was charged until its last record (A job that started in an earlier journal file is left out)
+bool load_journal_trace(trace_reader * reader) {
+    journal_header header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 || header.magic != JOURNAL_MAGIC) {
+        rewind(reader->file);
+        return false;
+    }
+    if (header.version != JOURNAL_VERSION || header.record_size != sizeof(journal_record)) {
+        fprintf(stderr, "Journal %s has version %u and %u byte records, expected version %d and %zu\n",
+                config.simulate_trace, header.version, header.record_size, JOURNAL_VERSION, sizeof(journal_record));
+        exit(EXIT_FAILURE);
+    }
+    reader->journal = true;
+    // Jobs by their job id, or by their pid without one (At most half full)
+    size_t index_capacity = 1;
+    while (index_capacity < 2 * header.count + 2) {
+        index_capacity *= 2;
+    }
+    journal_job_entry * job_index = calloc(index_capacity, sizeof(journal_job_entry));
+    size_t job_capacity = INITIAL_PROCESSES;
+    reader->jobs = malloc(job_capacity * sizeof(trace_job));
+    if (job_index == NULL || reader->jobs == NULL) {
+        perror("Allocation failed in load_journal_trace()\n");
+        exit(EXIT_FAILURE);
+    }
+    journal_record records[4096];
+    uint64_t remaining = header.count;
+    size_t count;
+    while (remaining > 0 && (count = fread(records, sizeof(journal_record),
+                                           remaining < 4096 ? remaining : 4096, reader->file)) > 0) {
+        remaining -= count;
+        for (size_t i = 0; i < count; ++i) {
+            const journal_record * const record = &records[i];
+            int32_t key = record->job_id != 0 ? record->job_id : record->pid;
+            if (key <= 0) {
+                continue;
+            }
+            size_t slot = ((uint64_t) (uint32_t) key * 0x9e3779b97f4a7c15ULL) >> 32 & (index_capacity - 1);
+            while (job_index[slot].key != 0 && job_index[slot].key != key) {
+                slot = (slot + 1) & (index_capacity - 1);
+            }
+            if ((record->old_status == UNUSED || record->old_status == TERMINATED) && record->new_status != TERMINATED) {
+                // A new job (Its pid may be that of an earlier one)
+                if (reader->job_count == job_capacity) {
+                    job_capacity *= 2;
+                    trace_job * jobs = realloc(reader->jobs, job_capacity * sizeof(trace_job));
+                    if (jobs == NULL) {
+                        perror("Realloc failed in load_journal_trace()\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    reader->jobs = jobs;
+                }
+                reader->jobs[reader->job_count] = (trace_job) {
+                    .arrival = record->time_ns, .work = 0, .budget = record->remaining_ns
+                };
+                job_index[slot].key = key;
+                job_index[slot].job = (int32_t) reader->job_count++;
+            } else if (job_index[slot].key == key) {
+                trace_job * const job = &reader->jobs[job_index[slot].job];
+                job->work = job->budget - record->remaining_ns;
+            }
+        }
+    }
+    free(job_index);
+    // Arrivals from the first one on, jobs that never ran are left out
+    size_t kept = 0;
+    int64_t start = reader->job_count > 0 ? reader->jobs[0].arrival : 0;
+    for (size_t i = 0; i < reader->job_count; ++i) {
+        trace_job job = reader->jobs[i];
+        if (job.work > 0) {
+            job.arrival -= start;
+            reader->jobs[kept++] = job;
+        }
+    }
+    reader->job_count = kept;
+    return true;
+}
+
+// Read the next job of a trace, returns false at its end (Invalid lines are reported and skipped)
+bool read_trace_job(trace_reader * reader, trace_job * job) {
+    if (reader->journal) {
+        if (reader->next_job == reader->job_count) {
+            return false;
+        }
+        *job = reader->jobs[reader->next_job++];
+        return true;
+    }
+    while (getline(&reader->line, &reader->line_size, reader->file) >= 0) {
+        reader->line_number++;
+        char * args[4];
+        if (get_input(reader->line, args, 4) == NULL || args[0][0] == '#') {
+            continue;
+        }
+        bool valid = args[1] != NULL && parse_runtime(args[1], &job->work);
+        if (valid && strcmp(args[0], "0") == 0) {
+            job->arrival = 0;
+        } else {
+            valid = valid && parse_runtime(args[0], &job->arrival);
+        }
+        if (args[1] != NULL && args[2] != NULL) {
+            valid = valid && parse_runtime(args[2], &job->budget);
+        } else {
+            job->budget = job->work;
+        }
+        if (!valid) {
+            fprintf(stderr, "Invalid job on line %ld of %s\n", reader->line_number, config.simulate_trace);
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Admit the synthetic process of an arriving job exactly like perform_run admits a launched one
+bool simulate_arrival(const trace_job * job, pid_t pid) {
+    int index = allocate_process_slot();
+    if (index < 0) {
+        return false;
+    }
+    int cpu = pick_cpu();
+    bool start = cpus[cpu].running < 0;
+    admit_process(index, pid, job->budget, NULL);
+    process_records[index].simulated_work = job->work;
+    queue_admitted_process(index, cpu, start);
+    return true;
+}
+
+// Run the trace to its end: the virtual clock jumps to the next arrival, exit or end of slice, whichever comes first
+void run_simulation(void) {
+    trace_reader reader = {.file = fopen(config.simulate_trace, "r")};
+    if (reader.file == NULL) {
+        perror("Fopen failed in run_simulation()\n");
+        exit(EXIT_FAILURE);
+    }
+    load_journal_trace(&reader);
+    struct timespec wall_start;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    trace_job next_job;
+    bool pending = read_trace_job(&reader, &next_job);
+    pid_t next_pid = 1;
+    long long admitted = 0;
+    long long rejected = 0;
+    long long live = 0;
+    long long events = 0;
+    while (pending || live > 0) {
+        int64_t next = pending ? next_job.arrival : INT64_MAX;
+        for (int cpu = 0; cpu < cpu_count; ++cpu) {
+            const int running = cpus[cpu].running;
+            if (running < 0) {
+                continue;
+            }
+            const process_record * const p = &process_records[running];
+            int64_t exit_time = p->charged_until + (p->simulated_work - p->runtime_used);
+            if (exit_time < next) {
+                next = exit_time;
+            }
+            if (cpus[cpu].slice_end > 0 && cpus[cpu].slice_end < next) {
+                next = cpus[cpu].slice_end;
+            }
+        }
+        if (next == INT64_MAX) {
+            // Nothing can happen any more (Only reachable if jobs were left without a CPU)
+            break;
+        }
+        // A trace out of order cannot move the clock back, the late job arrives now
+        if (next > simulated_now) {
+            simulated_now = next;
+        }
+        events++;
+        // Charge the running processes up to now, the ones that got all their work done exit
+        for (int cpu = 0; cpu < cpu_count; ++cpu) {
+            const int running = cpus[cpu].running;
+            if (running >= 0) {
+                charge_process(running);
+                if (process_records[running].runtime_used >= process_records[running].simulated_work) {
+                    process_exited(running, NULL, 0);
+                    live--;
+                }
+            }
+        }
+        while (pending && next_job.arrival <= simulated_now) {
+            if (simulate_arrival(&next_job, next_pid++)) {
+                admitted++;
+                live++;
+            } else {
+                rejected++;
+            }
+            pending = read_trace_job(&reader, &next_job);
+        }
+        expire_slices();
+        for (int cpu = 0; cpu < cpu_count; ++cpu) {
+            if (cpus[cpu].running < 0) {
+                schedule_cpu(cpu);
+            }
+        }
+    }
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall = (double) (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+    free(reader.line);
+    free(reader.jobs);
+    fclose(reader.file);
+    printf("simulated %lld jobs (%lld rejected) in %.3fs of virtual time, %lld events in %.3fs (%.0f events/s)\n",
+           admitted, rejected, (double) simulated_now / NS_PER_SEC, events, wall, wall > 0 ? events / wall : 0.0);
+    // The histograms of the hot paths stay empty on the virtual clock, wait and turnaround are the simulated ones
+    perform_stats(NULL);
+    if (config.stats_file != NULL) {
+        export_statistics();
+    }
+}
+
+/*
+    MAIN FUNCTION (Entry point of the program)
+*/
+
+// Values of the long-only command line options (Outside the range of short options)
+enum {
+    OPTION_BENCH_MIN_RUNTIME = 256,
+    OPTION_BENCH_LAUNCH = 257,
+    OPTION_MLFQ_LEVELS = 258,
+    OPTION_MLFQ_BOOST = 259,
+    OPTION_STATS_FILE = 260,
+    OPTION_STATS_INTERVAL = 261,
+    OPTION_SIMULATE = 262,
+    OPTION_AGING = 263,
+    OPTION_MAX_RESIDENT = 264,
+    OPTION_MAX_RSS = 265,
+    OPTION_PREFETCH = 266,
+    OPTION_COORDINATOR = 267,
+    OPTION_PLACEMENT = 268,
+    OPTION_JOURNAL = 269,
+    OPTION_JOURNAL_SIZE = 270
+};
+
+// Print the command line usage of the manager
+void print_usage(const char * program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  -m, --max-processes N   Maximum number of process records (0 for no limit, default %d)\n", config.max_processes);
+    fprintf(stderr, "  -c, --cpus N            Number of processes running concurrently, one per CPU (0 for all CPUs, default 1)\n");
+    fprintf(stderr, "  -a, --accounting MODE   Runtime charged to processes: wall (default) or cpu time\n");
+    fprintf(stderr, "  -p, --policy POLICY     Scheduling policy: sjf (default), srtf, rr, mlfq or cpath\n");
+    fprintf(stderr, "  -Q, --quantum TIME      Time slice of srtf, rr and mlfq level 0 (default 100ms)\n");
+    fprintf(stderr, "      --mlfq-levels N     Number of mlfq levels (default %d)\n", config.mlfq_levels);
+    fprintf(stderr, "      --mlfq-boost TIME   Period after which mlfq moves every process back to level 0 (default 1s)\n");
+    fprintf(stderr, "  -E, --estimates FILE    Learn the runtime of every program in FILE, order sjf/srtf by prediction capped by budget\n");
+    fprintf(stderr, "      --aging RATE        Take RATE times its waiting time off the sjf/srtf key of a READY process (default 0)\n");
+    fprintf(stderr, "      --max-resident N    Launch at most N jobs at a time, the others wait as PENDING (default no limit)\n");
+    fprintf(stderr, "      --max-rss SIZE      Launch no job while the resident jobs use SIZE bytes (K, M or G) of memory or more\n");
+    fprintf(stderr, "      --prefetch N        Launch a job only for an idle CPU or for at most N launched jobs waiting to run\n");
+    fprintf(stderr, "  -q, --ready-queue MODE  Selection of READY processes: heap (default) or scan\n");
+    fprintf(stderr, "  -g, --cgroup DIR        Run every job in its own group under a delegated cgroup v2 directory\n");
+    fprintf(stderr, "  -o, --capture DEST      Capture the stdout and stderr of every job: into DEST/job-PID.log or into memory\n");
+    fprintf(stderr, "  -l, --listen PATH       Accept clients on a SOCK_SEQPACKET Unix socket at PATH\n");
+    fprintf(stderr, "      --stats-file FILE   Export the statistics as JSON to FILE periodically\n");
+    fprintf(stderr, "      --stats-interval TIME Period of the statistics export (default 10s)\n");
+    fprintf(stderr, "      --journal FILE      Record every status change in the binary journal FILE (Replayable with --simulate)\n");
+    fprintf(stderr, "      --journal-size SIZE Size (K, M or G) the journal is rotated to FILE.1 at (default 64M)\n");
+    fprintf(stderr, "  -S, --state FILE        Keep the process table in FILE (e.g. under /dev/shm), reattach to its jobs on restart\n");
+    fprintf(stderr, "  -s, --spawn MODE        Launch of processes: spawn (posix_spawn, default) or fork\n");
+    fprintf(stderr, "  -w, --spawn-workers N   Threads launching the jobs of a runbatch (default 1)\n");
+    fprintf(stderr, "      --coordinator SOCKETS Run no jobs, forward the commands to the managers listening on SOCKETS (a,b,...)\n");
+    fprintf(stderr, "      --placement MODE    Node of a run in coordinator mode: least-loaded (default) or hash\n");
+    fprintf(stderr, "      --simulate TRACE    Replay a trace of jobs on a virtual clock, without running any process\n");
+    fprintf(stderr, "      --bench-min-runtime Benchmark the min runtime kernels and exit\n");
+    fprintf(stderr, "      --bench-launch      Benchmark the launch paths and exit\n");
+    fprintf(stderr, "  -h, --help              Show this help\n");
+}
+
+// Parse the command line options into the manager configuration, exits on invalid options
+void parse_options(int argc, char * argv[]) {
+    static const struct option options[] = {
+        {"max-processes", required_argument, NULL, 'm'},
+        {"ready-queue", required_argument, NULL, 'q'},
+        {"cpus", required_argument, NULL, 'c'},
+        {"accounting", required_argument, NULL, 'a'},
+        {"policy", required_argument, NULL, 'p'},
+        {"quantum", required_argument, NULL, 'Q'},
+        {"mlfq-levels", required_argument, NULL, OPTION_MLFQ_LEVELS},
+        {"mlfq-boost", required_argument, NULL, OPTION_MLFQ_BOOST},
+        {"cgroup", required_argument, NULL, 'g'},
+        {"state", required_argument, NULL, 'S'},
+        {"listen", required_argument, NULL, 'l'},
+        {"capture", required_argument, NULL, 'o'},
+        {"stats-file", required_argument, NULL, OPTION_STATS_FILE},
+        {"stats-interval", required_argument, NULL, OPTION_STATS_INTERVAL},
+        {"simulate", required_argument, NULL, OPTION_SIMULATE},
+        {"estimates", required_argument, NULL, 'E'},
+        {"aging", required_argument, NULL, OPTION_AGING},
+        {"max-resident", required_argument, NULL, OPTION_MAX_RESIDENT},
+        {"max-rss", required_argument, NULL, OPTION_MAX_RSS},
+        {"prefetch", required_argument, NULL, OPTION_PREFETCH},
+        {"coordinator", required_argument, NULL, OPTION_COORDINATOR},
+        {"placement", required_argument, NULL, OPTION_PLACEMENT},
+        {"journal", required_argument, NULL, OPTION_JOURNAL},
+        {"journal-size", required_argument, NULL, OPTION_JOURNAL_SIZE},
+        {"spawn", required_argument, NULL, 's'},
+        {"spawn-workers", required_argument, NULL, 'w'},
+        {"bench-min-runtime", no_argument, NULL, OPTION_BENCH_MIN_RUNTIME},
+        {"bench-launch", no_argument, NULL, OPTION_BENCH_LAUNCH},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "m:q:c:a:p:Q:E:g:S:l:o:s:w:h", options, NULL)) != -1) {
+        switch (option) {
+            case 'm': {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 0 || value > INT_MAX / 4) {
+                    fprintf(stderr, "Invalid maximum number of processes: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.max_processes = (int) value;
+                break;
+            }
+            case 'c': {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 0 || value > CPU_SETSIZE) {
+                    fprintf(stderr, "Invalid number of CPUs: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.cpus = (int) value;
+                break;
+            }
+            case 'w': {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 1 || value > 256) {
+                    fprintf(stderr, "Invalid number of spawn workers: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.spawn_workers = (int) value;
+                break;
+            }
+            case 'p':
+                if (strcmp(optarg, "sjf") == 0) {
+                    config.policy = POLICY_SJF;
+                } else if (strcmp(optarg, "srtf") == 0) {
+                    config.policy = POLICY_SRTF;
+                } else if (strcmp(optarg, "rr") == 0) {
+                    config.policy = POLICY_RR;
+                } else if (strcmp(optarg, "mlfq") == 0) {
+                    config.policy = POLICY_MLFQ;
+                } else if (strcmp(optarg, "cpath") == 0) {
+                    config.policy = POLICY_CRITICAL_PATH;
+                } else {
+                    fprintf(stderr, "Invalid scheduling policy: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                config.listen_path = optarg;
+                break;
+            case 'S':
+                config.state_file = optarg;
+                break;
+            case 'o':
+                if (strcmp(optarg, "memory") == 0) {
+                    config.capture = CAPTURE_MEMORY;
+                } else {
+                    config.capture = CAPTURE_FILES;
+                    config.capture_dir = optarg;
+                }
+                break;
+            case 'g':
+                config.cgroup = optarg;
+                break;
+            case 'Q':
+                if (!parse_runtime(optarg, &config.quantum)) {
+                    fprintf(stderr, "Invalid quantum: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPTION_MLFQ_LEVELS: {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 1 || value > 16) {
+                    fprintf(stderr, "Invalid number of mlfq levels: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.mlfq_levels = (int) value;
+                break;
+            }
+            case OPTION_AGING: {
+                char * end;
+                double value = strtod(optarg, &end);
+                if (*optarg == '\0' || *end != '\0' || !(value >= 0) || value > 1000) {
+                    fprintf(stderr, "Invalid aging rate: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.aging_rate = value;
+                break;
+            }
+            case OPTION_MAX_RESIDENT: {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 1 || value > INT_MAX / 4) {
+                    fprintf(stderr, "Invalid maximum number of resident jobs: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.max_resident = (int) value;
+                break;
+            }
+            case OPTION_PREFETCH: {
+                char * end;
+                long value = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || value < 0 || value > INT_MAX / 4) {
+                    fprintf(stderr, "Invalid prefetch window: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.prefetch = (int) value;
+                break;
+            }
+            case OPTION_COORDINATOR:
+                config.coordinator_nodes = optarg;
+                break;
+            case OPTION_PLACEMENT:
+                if (strcmp(optarg, "least-loaded") == 0) {
+                    config.placement = PLACEMENT_LEAST_LOADED;
+                } else if (strcmp(optarg, "hash") == 0) {
+                    config.placement = PLACEMENT_HASH;
+                } else {
+                    fprintf(stderr, "Invalid placement: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPTION_JOURNAL:
+                config.journal_file = optarg;
+                break;
+            case OPTION_JOURNAL_SIZE:
+                if (!parse_size(optarg, &config.journal_size) || config.journal_size < JOURNAL_SIZE_MIN) {
+                    fprintf(stderr, "Invalid journal size: %s (At least %d bytes)\n", optarg, JOURNAL_SIZE_MIN);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPTION_MAX_RSS:
+                if (!parse_size(optarg, &config.max_rss)) {
+                    fprintf(stderr, "Invalid memory limit: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'E':
+                config.estimates_file = optarg;
+                break;
+            case OPTION_SIMULATE:
+                config.simulate_trace = optarg;
+                break;
+            case OPTION_STATS_FILE:
+                config.stats_file = optarg;
+                break;
+            case OPTION_STATS_INTERVAL:
+                if (!parse_runtime(optarg, &config.stats_interval)) {
+                    fprintf(stderr, "Invalid statistics export interval: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPTION_MLFQ_BOOST:
+                if (!parse_runtime(optarg, &config.mlfq_boost)) {
+                    fprintf(stderr, "Invalid mlfq boost period: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'a':
+                if (strcmp(optarg, "wall") == 0) {
+                    config.accounting = ACCOUNTING_WALL;
+                } else if (strcmp(optarg, "cpu") == 0) {
+                    config.accounting = ACCOUNTING_CPU;
+                } else {
+                    fprintf(stderr, "Invalid accounting mode: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'q':
+                if (strcmp(optarg, "heap") == 0) {
+                    config.ready_queue = READY_QUEUE_HEAP;
+                } else if (strcmp(optarg, "scan") == 0) {
+                    config.ready_queue = READY_QUEUE_SCAN;
+                } else {
+                    fprintf(stderr, "Invalid ready queue mode: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                if (strcmp(optarg, "spawn") == 0) {
+                    config.spawn = SPAWN_POSIX;
+                } else if (strcmp(optarg, "fork") == 0) {
+                    config.spawn = SPAWN_FORK;
+                } else {
+                    fprintf(stderr, "Invalid spawn mode: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPTION_BENCH_LAUNCH:
+                bench_launch();
+                exit(EXIT_SUCCESS);
+            case OPTION_BENCH_MIN_RUNTIME:
+                bench_min_runtime();
+                exit(EXIT_SUCCESS);
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind < argc) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    // The table scan selects on the remaining runtime, it cannot order processes for the other policies
+    if (config.ready_queue == READY_QUEUE_SCAN && config.policy != POLICY_SJF && config.policy != POLICY_SRTF) {
+        fprintf(stderr, "The scan ready queue only supports the sjf and srtf policies\n");
+        exit(EXIT_FAILURE);
+    }
+    // The table scan compares budgets only
+    if (config.ready_queue == READY_QUEUE_SCAN && (config.estimates_file != NULL || config.aging_rate > 0)) {
+        fprintf(stderr, "The scan ready queue does not support runtime estimates or aging\n");
+        exit(EXIT_FAILURE);
+    }
+    // Synthetic processes have no CPU clock, cgroup, output or pid worth keeping across a restart
+    if (config.simulate_trace != NULL && (config.accounting == ACCOUNTING_CPU || config.cgroup != NULL ||
+                                          config.state_file != NULL || config.capture != CAPTURE_NONE ||
+                                          config.listen_path != NULL)) {
+        fprintf(stderr, "A simulation cannot be combined with -a cpu, -g, -S, -o or -l\n");
+        exit(EXIT_FAILURE);
+    }
+    // The jobs of a coordinator live on its nodes
+    if (config.coordinator_nodes != NULL && (config.simulate_trace != NULL || config.state_file != NULL ||
+                                             config.cgroup != NULL || config.capture != CAPTURE_NONE ||
+                                             config.journal_file != NULL)) {
+        fprintf(stderr, "The coordinator mode cannot be combined with --simulate, -S, -g, -o or --journal\n");
+        exit(EXIT_FAILURE);
+    }
+    // A replay reads its trace while the journal of the replay is being written
+    if (config.simulate_trace != NULL && config.journal_file != NULL &&
+        strcmp(config.simulate_trace, config.journal_file) == 0) {
+        fprintf(stderr, "A simulation cannot write its journal to its trace\n");
+        exit(EXIT_FAILURE);
+    }
+    // Trace jobs arrive straight into the ready queues
+    if (config.simulate_trace != NULL && admission_limited()) {
+        fprintf(stderr, "A simulation cannot be combined with admission control\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    // A job launched stopped by posix_spawn runs this binary first, it must not touch any manager state
+    if (argc > 2 && strcmp(argv[1], SPAWN_STOPPED_ARGUMENT) == 0) {
+        spawn_stopped_trampoline(argv + 2);
+    }
+    parse_options(argc, argv);
+    if (config.cgroup != NULL) {
+        setup_cgroup_root();
+    }
+    if (config.capture != CAPTURE_NONE) {
+        setup_capture();
+    }
+    if (config.estimates_file != NULL) {
+        setup_estimates();
+    }
+    if (config.coordinator_nodes != NULL) {
+        setup_coordinator();
+    }
+    select_min_runtime_kernel();
+    simulating = config.simulate_trace != NULL;
+    setup_cpus();
+    // First, initialize the process records to UNUSED status
     initialise_process_records();
+    if (simulating) {
+        if (config.journal_file != NULL) {
+            setup_journal();
+        }
+        run_simulation();
+        close_journal();
+        return EXIT_SUCCESS;
+    }
 
     // Create a pipe to communicate between the user interface and the process manager
     int pipefd[2];
@@ -447,89 +6046,149 @@ int main(void) {
     if (pid == 0) {
         // This process will only write to the pipe
         close(pipefd[0]);
-        char buffer[80];
+        // Nor does it keep the state file locked if the manager dies (The mapping holds the locked file open as well)
+        if (state_fd >= 0) {
+            munmap(state_map, state_map_size);
+            close(state_fd);
+        }
+        char * buffer = NULL;
+        size_t buffer_size = 0;
+        ssize_t length;
+        // Only prompt a human, scripted clients just stream their commands
+        bool interactive = isatty(STDIN_FILENO);
         while (true) {
             // Display the prompt and get the input from the terminal
-            printf("\x1B[34m""cs205""\x1B[0m""$ ");
-            if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
+            if (interactive) {
+                printf("\x1B[34m""cs205""\x1B[0m""$ ");
+                fflush(stdout);
+            }
+            if ((length = getline(&buffer, &buffer_size, stdin)) < 0) {
                 // If the input is NULL, break the loop
                 break;
             }
-            // Write the input to the pipe with a newline character at the end
-            buffer[strcspn(buffer, "\n")] = '\0';
-            write(pipefd[1], buffer, sizeof(buffer));
+            // Write the input to the pipe with a newline character at the end (The framing used by the manager)
+            if (length == 0 || buffer[length - 1] != '\n') {
+                char * grown = realloc(buffer, length + 2);
+                if (grown == NULL) {
+                    break;
+                }
+                buffer = grown;
+                buffer[length++] = '\n';
+                buffer[length] = '\0';
+            }
+            if (!write_all(pipefd[1], buffer, length)) {
+                perror("Write failed in user interface\n");
+                break;
+            }
             // If the input is "exit", break the loop
-            if (strcmp(buffer, "exit") == 0) {
+            if (strcmp(buffer, "exit\n") == 0) {
                 break;
             }
-            // Sleep here to avoid the process manager from reading the input before the user interface writes it
-            sleep(1);
         }
+        free(buffer);
         close(pipefd[1]);
     } 
     else {
         // This process manager will only read from the pipe and perform the required operations
         int flags = fcntl(pipefd[0], F_GETFL, 0);
-        // I set the pipe to non-blocking mode to avoid the process manager from blocking while reading
+        // The pipe is non-blocking so that a spurious wakeup never blocks the event loop
         fcntl(pipefd[0], F_SETFL, flags | O_NONBLOCK);
         close(pipefd[1]);
-        // Set up the signal handlers for SIGCHLD (Automatically handle child process termination)
-        setup_signal_handlers();
+        // Set up the event loop: SIGCHLD is delivered through a signalfd (Automatically handle child process termination)
+        setup_event_loop(pipefd[0]);
+        // Only now that the user interface is forked: the flusher thread lives in the manager alone
+        if (config.journal_file != NULL) {
+            setup_journal();
+        }
+        if (config.listen_path != NULL) {
+            setup_control_socket();
+        }
+        if (state_recovered) {
+            recover_processes();
+        }
         // Flag to check if the user wants to exit the program
-        bool exit = false;
+        bool running = true;
 
-        // Loop to read the input from the pipe and perform the required operations
-        while (true) {
-            // If the exit flag is true, break the loop
-            if (exit) {
-                break;
-            }
-            // Reading from pipe
-            char buffer[80];
-            int bytes_read = read(pipefd[0], buffer, sizeof(buffer));
-            // If there are bytes to read, process the input
-            if (bytes_read > 0) {
-                buffer[bytes_read] = '\0';
-                char * args[10];
-                int args_count_max = sizeof(args) / sizeof(args[0]);
-                // Get the command and arguments from the input
-                char * command = get_input(buffer, args, args_count_max);
-                if (strcmp(command, "run") == 0) {
-                    perform_run(args);
-                } else if (strcmp(command, "stop") == 0) {
-                    perform_stop(atoi(args[1]));
-                } else if (strcmp(command, "resume") == 0) {
-                    perform_resume(atoi(args[1]));
-                } else if (strcmp(command, "kill") == 0) {
-                    perform_kill(atoi(args[1]));
-                } else if (strcmp(command, "list") == 0) {
-                    perform_list();
-                } else if (strcmp(command, "exit") == 0) {
-                    // Set the exit flag to true and call the perform_exit function
-                    exit = true;
-                    perform_exit();
-                    break;
-                } else {
-                    printf("Unknown command: %s\n", command);
+        // Wait for events and perform the required operations as soon as they arrive
+        while (running) {
+            struct epoll_event events[64];
+            // Block until a command, a child termination or an accounting tick arrives (No timeout: idle means asleep)
+            int event_count = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+            if (event_count == -1) {
+                if (errno == EINTR) {
+                    continue;
                 }
+                perror("Epoll_wait failed in main\n");
+                break;
             }
-            // If there is a running process, update its runtime periodically
-            if (running_process_index >= 0) {
-                process_record * const p = &process_records[running_process_index];
-                time_t current_time = time(NULL);
-                elapsed_time = difftime(current_time, start_time);
-                if (elapsed_time > 0) {
-                    p->remaining_runtime -= elapsed_time;
-                    start_time = current_time;
+            int64_t batch_start = monotonic_ns();
+            // Reap first, so the commands of this batch see every exit reported so far
+            bool sigchld = false;
+            for (int i = 0; i < event_count; ++i) {
+                event_source source = (event_source) (events[i].data.u64 >> 32);
+                if (source < EVENT_SOURCES) {
+                    events_handled[source]++;
+                }
+                if (source == EVENT_PIDFD) {
+                    reap_process((int) (uint32_t) events[i].data.u64);
+                } else if (source == EVENT_SIGNAL) {
+                    sigchld = true;
+                }
+            }
+            // Then whatever exited without a pidfd event
+            if (sigchld) {
+                drain_signal_fd();
+                reap_children();
+            }
+            for (int i = 0; i < event_count && running; ++i) {
+                switch ((event_source) (events[i].data.u64 >> 32)) {
+                    case EVENT_COMMAND_PIPE:
+                        running = handle_command_pipe(pipefd[0]);
+                        break;
+                    case EVENT_SIGNAL:
+                    case EVENT_PIDFD:
+                        // Already handled above
+                        break;
+                    case EVENT_TIMER:
+                        update_running_runtime();
+                        break;
+                    case EVENT_LISTEN:
+                        accept_clients();
+                        break;
+                    case EVENT_CLIENT:
+                        running = handle_client((int) (uint32_t) events[i].data.u64, events[i].events);
+                        break;
+                    case EVENT_QUANTUM:
+                        expire_slices();
+                        break;
+                    case EVENT_OUTPUT:
+                        drain_output((int) (uint32_t) events[i].data.u64);
+                        break;
+                    case EVENT_STATS:
+                        export_statistics();
+                        break;
+                    case EVENT_SOURCES:
+                        break;
+                }
+            }
+            if (!running) {
+                break;
+            }
+            // Exits and kills of this batch may have made room for PENDING jobs
+            admit_pending_processes();
+            // If a CPU has no running process, call the scheduler for it (Trigger: running process = -1)
+            for (int cpu = 0; cpu < cpu_count; ++cpu) {
+                if (cpus[cpu].running < 0) {
+                    schedule_cpu(cpu);
                 }
-            } else {
-                // If there is no running process, call the scheduler (Trigger: running_process_index = -1)
-                scheduler();
             }
-            // Sleep for 100ms to avoid busy waiting and to give the user interface time to write to the pipe
-            usleep(100000);
+            update_accounting_timer();
+            update_quantum_timer();
+            histogram_record_since(HISTOGRAM_LOOP, batch_start);
         }
         close(pipefd[0]);
+        close_control_socket();
+        close_journal();
     }
 	return EXIT_SUCCESS;
 }
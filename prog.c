@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    SYNTHETIC JOB (./bin/prog CPU_FRACTION DURATION, the arguments of "run ./bin/prog CPU_FRACTION DURATION")
+    Works for DURATION in periods of PERIOD_NS: spinning for CPU_FRACTION of each period and sleeping for the rest.
+    Only time it actually spins or sleeps counts, so a job stopped by the manager is not making progress.
+*/
+
+enum {
+    NS_PER_MS = 1000000,
+    NS_PER_SEC = 1000000000,
+    PERIOD_NS = 10 * NS_PER_MS
+};
+
+int64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (int64_t) now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Same syntax as the runtime budgets of the manager: seconds, or a number with a unit ns, us, ms, s or m
+int64_t parse_duration(const char * text) {
+    char * end;
+    double value = strtod(text, &end);
+    double scale = NS_PER_SEC;
+    if (strcmp(end, "ns") == 0) {
+        scale = 1;
+    } else if (strcmp(end, "us") == 0) {
+        scale = 1000;
+    } else if (strcmp(end, "ms") == 0) {
+        scale = NS_PER_MS;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60.0 * NS_PER_SEC;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return -1;
+    }
+    return end == text || value <= 0 ? -1 : (int64_t) (value * scale);
+}
+
+int main(int argc, char * argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s CPU_FRACTION DURATION\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    double cpu_fraction = strtod(argv[1], NULL);
+    int64_t duration = parse_duration(argv[2]);
+    if (cpu_fraction < 0 || cpu_fraction > 1 || duration < 0) {
+        fprintf(stderr, "Invalid arguments: %s %s\n", argv[1], argv[2]);
+        return EXIT_FAILURE;
+    }
+    int64_t progress = 0;
+    while (progress < duration) {
+        int64_t period = duration - progress < PERIOD_NS ? duration - progress : PERIOD_NS;
+        // Spin on the CPU clock of the process, which does not advance while it is stopped
+        int64_t spin = (int64_t) (period * cpu_fraction);
+        int64_t spin_start = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        while (clock_ns(CLOCK_PROCESS_CPUTIME_ID) - spin_start < spin) {
+        }
+        // Sleep for the rest of the period, a stop during the sleep only delays the next period
+        int64_t rest = period - spin;
+        if (rest > 0) {
+            struct timespec sleep_time = {.tv_sec = rest / NS_PER_SEC, .tv_nsec = rest % NS_PER_SEC};
+            while (nanosleep(&sleep_time, &sleep_time) == -1) {
+            }
+        }
+        progress += period;
+    }
+    return EXIT_SUCCESS;
+}